@@ -70,6 +70,35 @@ void flashWrite( unsigned char *addr, unsigned int len, unsigned char *buf )
   FCTL3 = FWKEY;                // Clear Lock bit
   FCTL1 = FWKEY + WRT;          // Set WRT bit for write operation
 
+  // Bytes before the first long-word boundary
+  while ( len && ((unsigned int)addr & 3) )
+  {
+    *addr++ = *buf++;
+    len--;
+  }
+
+  /* Long-word mode programs 4 bytes in one cycle. Programming starts when the
+   * last byte of the long-word has been written.
+   */
+  if ( len >= 4 )
+  {
+    FCTL1 = FWKEY + BLKWRT;     // Set BLKWRT bit for long-word write
+
+    while ( len >= 4 )
+    {
+      addr[0] = buf[0];
+      addr[1] = buf[1];
+      addr[2] = buf[2];
+      addr[3] = buf[3];
+
+      addr += 4;
+      buf += 4;
+      len -= 4;
+    }
+
+    FCTL1 = FWKEY + WRT;        // Back to byte write for the rest
+  }
+
   while ( len-- )
   {
     *addr++ = *buf++;            // Write value to flash
@@ -76,6 +76,9 @@
 #define NVID_ALARM_MIN                    ( 0x201A ) // - 0x2024
 #define NVID_ALARM_HOUR                   ( 0x2024 ) // - 0x202E
 
+/* one item per diary record so that changing one does not copy the others */
+#define NVID_DIARY_RECORD                 ( 0x2100 ) // - 0x2107
+
 #define NVID_TOP_OLED_CONTRAST_DAY        ( 0x3000 )
 #define NVID_BOTTOM_OLED_CONTRAST_DAY     ( 0x3001 )
 #define NVID_TOP_OLED_CONTRAST_NIGHT      ( 0x3002 )
@@ -95,11 +95,19 @@
 
 #define OSAL_NV_PAGE_HDR_OFFSET 0
 
-#define OSAL_NV_MAX_HOT         1
+/* Number of items whose location is kept in RAM.  When there are more items
+ * than this the ones that are not in the index are found by walking the pages.
+ */
+#ifndef OSAL_NV_INDEX_SIZE
+  #define OSAL_NV_INDEX_SIZE    96
+#endif
 
-static const unsigned int hotIds[OSAL_NV_MAX_HOT] = {
-  NVID_LINK_KEY
-};
+/* The background task compacts a page when it has less than this many bytes
+ * free and at least this many bytes can be recovered by compacting it.
+ */
+#ifndef OSAL_NV_EARLY_COMPACT
+  #define OSAL_NV_EARLY_COMPACT  128
+#endif
 
 /*********************************************************************
  * MACROS
@@ -129,6 +137,11 @@ static const unsigned int hotIds[OSAL_NV_MAX_HOT] = {
 #define OSAL_NV_PAGE_TO_PTR(pg) \
   ((unsigned char *)((unsigned char *)((HAL_NV_PAGE_BEG + ((pg) * OSAL_NV_PHY_PER_PG)) * HAL_FLASH_PAGE_SIZE)))
 
+// An index entry is the page and the offset of the item data packed into one word.
+#define OSAL_NV_INDEX_LOC( PG, OFF )  (((PG) * OSAL_NV_PAGE_SIZE) + (OFF))
+#define OSAL_NV_INDEX_PG( LOC )       ((unsigned char)((LOC) / OSAL_NV_PAGE_SIZE))
+#define OSAL_NV_INDEX_OFF( LOC )      ((LOC) % OSAL_NV_PAGE_SIZE)
+
 
 /*
  *  This macro is for use by other macros to form a fully valid C statement.
@@ -241,9 +254,20 @@ static unsigned int pgLost[OSAL_NV_PAGES_USED];
 
 static unsigned char pgRes;  // Page reserved for item compacting transfer.
 
-// NV page and offsets for hot items.
-static unsigned char hotPg[OSAL_NV_MAX_HOT];
-static unsigned int hotOff[OSAL_NV_MAX_HOT];
+/* Location of the current copy of each item, built once by initNV() and kept up
+ * to date wherever an item is written, moved or zeroed.  The Id is not kept in
+ * RAM because it can be read from the item header.
+ */
+static unsigned int nvIndex[OSAL_NV_INDEX_SIZE];
+static unsigned char nvIndexCnt;
+static unsigned char nvIndexFull;  // An item did not fit so a miss must walk the pages.
+
+/* An entry moves one place towards the front each time it is found, so the
+ * items that are looked up most often end up at the front of the index.
+ */
+static unsigned long nvIndexHits;
+static unsigned long nvIndexMisses;
+static unsigned long nvIndexCompares;  // Entries compared by the lookups that hit.
 
 /*********************************************************************
  * LOCAL FUNCTIONS
@@ -257,6 +281,7 @@ static void   erasePage( unsigned char pg );
 static unsigned char  compactPage( unsigned char srcPg, unsigned int skipId );
 
 static unsigned int findItem( unsigned int id, unsigned char *findPg );
+static unsigned int scanItem( unsigned int id, unsigned char *findPg );
 static unsigned char  initItem( unsigned char flag, unsigned int id, unsigned int len, void *buf );
 static void   setItem( unsigned char pg, unsigned int offset, eNvHdrEnum stat );
 
@@ -269,8 +294,11 @@ static void   writeBuf( unsigned char pg, unsigned int offset, unsigned int len,
 static void   xferBuf( unsigned char srcPg, unsigned int srcOff, unsigned char dstPg, unsigned int dstOff, unsigned int len );
 
 static unsigned char  writeItem( unsigned char pg, unsigned int id, unsigned int len, void *buf, unsigned char flag );
-static unsigned char  hotItem(unsigned int id);
-static void   hotItemUpdate(unsigned char pg, unsigned int off, unsigned int id);
+static void   buildIndex( void );
+static unsigned char  indexFind( unsigned int id );
+static void   indexUpdate( unsigned char pg, unsigned int off, unsigned int id );
+static void   indexRemove( unsigned char pg, unsigned int off );
+static unsigned char  earlyCompactPage( void );
 
 
 /*********************************************************************/
@@ -427,6 +455,8 @@ static unsigned char initNV( void )
     erasePage( pgRes );  // The last page erase had been interrupted by a power-cycle.
   }
 
+  buildIndex();
+
   return TRUE;
 }
 
@@ -591,6 +621,8 @@ static void erasePage( unsigned char pg )
 
   pgOff[pg] = OSAL_NV_PAGE_HDR_SIZE;
   pgLost[pg] = 0;
+
+  indexRemove( pg, OSAL_NV_ITEM_NULL );
 }
 
 /*********************************************************************
@@ -681,7 +713,7 @@ static unsigned char compactPage( unsigned char srcPg, unsigned int skipId )
           }
           else
           {
-            hotItemUpdate(pgRes, dstOff+OSAL_NV_HDR_SIZE, hdr.id);
+            indexUpdate(pgRes, dstOff+OSAL_NV_HDR_SIZE, hdr.id);
           }
         }
         else
@@ -697,7 +729,9 @@ static unsigned char compactPage( unsigned char srcPg, unsigned int skipId )
 
   if (rtrn == FALSE)
   {
+    // Items that were already moved point into the erased page.
     erasePage(pgRes);
+    buildIndex();
   }
   else if (skipId == OSAL_NV_ITEM_NULL)
   {
@@ -712,6 +746,8 @@ static unsigned char compactPage( unsigned char srcPg, unsigned int skipId )
  * @fn      findItem
  *
  * @brief   Find an item Id in NV and return the page and offset to its data.
+ *          The RAM index is used unless the old source copy is asked for
+ *          or the index is full and does not have the item.
  *
  * @param   id - Valid NV item Id.
  *
@@ -719,10 +755,57 @@ static unsigned char compactPage( unsigned char srcPg, unsigned int skipId )
  *          otherwise OSAL_NV_ITEM_NULL.
  *
  *          The page containing the item, if found;
- *          otherwise no valid assignment made - left equal to item Id.
+ *          otherwise OSAL_NV_PAGE_NULL.
  *
  */
 static unsigned int findItem( unsigned int id, unsigned char *findPg )
+{
+  unsigned char idx;
+  unsigned int loc;
+
+  if ( (id & OSAL_NV_SOURCE_ID) == 0 )
+  {
+    idx = indexFind( id );
+
+    if ( idx < nvIndexCnt )
+    {
+      nvIndexHits++;
+      nvIndexCompares += idx + 1;
+
+      loc = nvIndex[idx];
+
+      if ( idx != 0 )
+      {
+        nvIndex[idx] = nvIndex[idx-1];
+        nvIndex[idx-1] = loc;
+      }
+
+      *findPg = OSAL_NV_INDEX_PG( loc );
+      return OSAL_NV_INDEX_OFF( loc );
+    }
+
+    nvIndexMisses++;
+
+    if ( !nvIndexFull )
+    {
+      *findPg = OSAL_NV_PAGE_NULL;
+      return OSAL_NV_ITEM_NULL;
+    }
+  }
+
+  return scanItem( id, findPg );
+}
+
+/*********************************************************************
+ * @fn      scanItem
+ *
+ * @brief   Find an item Id by walking the NV pages.
+ *
+ * @param   id - Valid NV item Id.
+ *
+ * @return  Same as findItem().
+ */
+static unsigned int scanItem( unsigned int id, unsigned char *findPg )
 {
   unsigned int off;
   unsigned char pg;
@@ -739,7 +822,7 @@ static unsigned int findItem( unsigned int id, unsigned char *findPg )
   // Now attempt to find the item as the "old" item of a failed/interrupted NV write.
   if ( (id & OSAL_NV_SOURCE_ID) == 0 )
   {
-    return findItem( (id | OSAL_NV_SOURCE_ID), findPg );
+    return scanItem( (id | OSAL_NV_SOURCE_ID), findPg );
   }
   else
   {
@@ -868,6 +951,8 @@ static void setItem( unsigned char pg, unsigned int offset, eNvHdrEnum stat )
     hdr.id = 0;
     flashWrite(OSAL_NV_PAGE_TO_PTR(pg) + offset, OSAL_NV_HDR_ITEM, (unsigned char*)(&hdr));
     pgLost[pg] += sz;
+
+    indexRemove( pg, offset + OSAL_NV_HDR_SIZE );
   }
 }
 
@@ -1132,7 +1217,7 @@ static unsigned char writeItem( unsigned char pg, unsigned int id, unsigned int
 
         if ( chk == hdr.chk )
         {
-          hotItemUpdate(pg, offset, hdr.id);
+          indexUpdate(pg, offset, hdr.id);
           rtrn = TRUE;
         }
       }
@@ -1161,49 +1246,140 @@ static unsigned char writeItem( unsigned char pg, unsigned int id, unsigned int
 }
 
 /*********************************************************************
- * @fn      hotItem
+ * @fn      buildIndex
+ *
+ * @brief   Walk the pages once and put the location of every item in the
+ *          index.  A new copy of an item wins over the old source copy.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+static void buildIndex( void )
+{
+  unsigned int offset, sz;
+  unsigned char pg;
+  osalNvHdr_t hdr;
+
+  nvIndexCnt = 0;
+  nvIndexFull = FALSE;
+
+  for ( pg = 0; pg < OSAL_NV_PAGES_USED; pg++ )
+  {
+    offset = OSAL_NV_PAGE_HDR_SIZE;
+
+    while ( offset < (OSAL_NV_PAGE_SIZE - OSAL_NV_HDR_SIZE) )
+    {
+      readHdr( pg, offset, (unsigned char *)(&hdr) );
+
+      if ( hdr.id == OSAL_NV_ERASED_ID )
+      {
+        break;
+      }
+
+      sz = OSAL_NV_DATA_SIZE( hdr.len );
+
+      if ( sz > (OSAL_NV_PAGE_SIZE - OSAL_NV_HDR_SIZE - offset) )
+      {
+        break;
+      }
+
+      offset += OSAL_NV_HDR_SIZE;
+
+      if ( (hdr.id != OSAL_NV_ZEROED_ID) &&
+           ((hdr.stat == OSAL_NV_ERASED_ID) || (indexFind( hdr.id ) >= nvIndexCnt)) )
+      {
+        indexUpdate( pg, offset, hdr.id );
+      }
+
+      offset += sz;
+    }
+  }
+}
+
+/*********************************************************************
+ * @fn      indexFind
  *
- * @brief   Look for the parameter 'id' in the hot items array.
+ * @brief   Look for the parameter 'id' in the index.
  *
  * @param   id - A valid NV item Id.
  *
- * @return  A valid index into the hot items if the item is hot; OSAL_NV_MAX_HOT if not.
+ * @return  A valid index entry if the item is in the index; nvIndexCnt if not.
  */
-static unsigned char hotItem(unsigned int id)
+static unsigned char indexFind( unsigned int id )
 {
-  unsigned char hotIdx;
+  unsigned char idx;
+  unsigned char *addr;
 
-  for (hotIdx = 0; hotIdx < OSAL_NV_MAX_HOT; hotIdx++)
+  for ( idx = 0; idx < nvIndexCnt; idx++ )
   {
-    if (hotIds[hotIdx] == id)
+    addr = OSAL_NV_PAGE_TO_PTR( OSAL_NV_INDEX_PG( nvIndex[idx] ) ) +
+           OSAL_NV_INDEX_OFF( nvIndex[idx] ) - OSAL_NV_HDR_SIZE + OSAL_NV_HDR_ID;
+
+    // Headers are not word aligned.
+    if ( (addr[0] | ((unsigned int)addr[1] << 8)) == id )
     {
       break;
     }
   }
 
-  return hotIdx;
+  return idx;
 }
 
 /*********************************************************************
- * @fn      hotItemUpdate
+ * @fn      indexUpdate
  *
- * @brief   If the parameter 'id' is a hot item, update the corresponding hot item data.
+ * @brief   Make the index point to the new location of item 'id'.
  *
- * @param   pg - The new NV page corresponding to the hot item.
- * @param   off - The new NV page offset corresponding to the hot item.
+ * @param   pg - The new NV page corresponding to the item.
+ * @param   off - The new NV page offset of the item data.
  * @param   id - A valid NV item Id.
  *
  * @return  none
  */
-static void hotItemUpdate(unsigned char pg, unsigned int off, unsigned int id)
+static void indexUpdate( unsigned char pg, unsigned int off, unsigned int id )
 {
-  unsigned char hotIdx = hotItem(id);
+  unsigned char idx = indexFind( id );
 
-  if (hotIdx < OSAL_NV_MAX_HOT)
+  if ( idx == nvIndexCnt )
   {
+    if ( nvIndexCnt == OSAL_NV_INDEX_SIZE )
     {
-      hotPg[hotIdx] = pg;
-      hotOff[hotIdx] = off;
+      nvIndexFull = TRUE;
+      return;
+    }
+
+    nvIndexCnt++;
+  }
+
+  nvIndex[idx] = OSAL_NV_INDEX_LOC( pg, off );
+}
+
+/*********************************************************************
+ * @fn      indexRemove
+ *
+ * @brief   Remove the index entry of an item that was zeroed or erased.
+ *
+ * @param   pg - NV page of the item.
+ * @param   off - NV page offset of the item data or OSAL_NV_ITEM_NULL
+ *                to remove every entry in the page.
+ *
+ * @return  none
+ */
+static void indexRemove( unsigned char pg, unsigned int off )
+{
+  unsigned char idx = 0;
+
+  while ( idx < nvIndexCnt )
+  {
+    if ( (OSAL_NV_INDEX_PG( nvIndex[idx] ) == pg) &&
+         ((off == OSAL_NV_ITEM_NULL) || (OSAL_NV_INDEX_OFF( nvIndex[idx] ) == off)) )
+    {
+      nvIndex[idx] = nvIndex[--nvIndexCnt];
+    }
+    else
+    {
+      idx++;
     }
   }
 }
@@ -1226,6 +1402,85 @@ void OsalNvInit( void *p )
   InitMasterResetKey();
 }
 
+/*********************************************************************
+ * @fn      OsalNvCompactPending
+ *
+ * @brief   Check if a page is getting full and is worth compacting.  This
+ *          does not take the mutex, OsalNvCompact() checks again.
+ *
+ * @param   none
+ *
+ * @return  TRUE if OsalNvCompact() has work to do
+ */
+unsigned char OsalNvCompactPending( void )
+{
+  return ( earlyCompactPage() != OSAL_NV_PAGE_NULL );
+}
+
+/*********************************************************************
+ * @fn      OsalNvCompact
+ *
+ * @brief   Compact a page that is getting full so that a later write does
+ *          not have to wait for the items to be copied and the page erased.
+ *          compactPage() needs more stack than the idle task has, so this
+ *          is called from the background task.
+ *
+ * @param   none
+ *
+ * @return  none
+ */
+void OsalNvCompact( void )
+{
+  unsigned char pg;
+  unsigned int xfer = OSAL_NV_ZEROED_ID;
+
+  xSemaphoreTake(NvalMutex,portMAX_DELAY);
+
+  pg = earlyCompactPage();
+
+  if ( pg != OSAL_NV_PAGE_NULL )
+  {
+    // Mark the old page as being in process of compaction (as initItem() does).
+    flashWrite(OSAL_NV_PAGE_TO_PTR(pg) + OSAL_NV_PAGE_HDR_OFFSET + OSAL_NV_PG_XFER,
+                                         OSAL_NV_HDR_ITEM, (unsigned char *)(&xfer));
+
+    (void)compactPage( pg, OSAL_NV_ITEM_NULL );
+  }
+
+  xSemaphoreGive(NvalMutex);
+}
+
+/*********************************************************************
+ * @fn      earlyCompactPage
+ *
+ * @brief   Find a page that is worth compacting before a write needs it.
+ *
+ * @param   none
+ *
+ * @return  The page to compact; OSAL_NV_PAGE_NULL if there is none.
+ */
+static unsigned char earlyCompactPage( void )
+{
+  unsigned char pg;
+
+  if ( pgRes == OSAL_NV_PAGE_NULL )
+  {
+    return OSAL_NV_PAGE_NULL;
+  }
+
+  for ( pg = 0; pg < OSAL_NV_PAGES_USED; pg++ )
+  {
+    if ( (pg != pgRes) &&
+         (pgOff[pg] > (OSAL_NV_PAGE_SIZE - OSAL_NV_EARLY_COMPACT)) &&
+         (pgLost[pg] >= OSAL_NV_EARLY_COMPACT) )
+    {
+      break;
+    }
+  }
+
+  return (pg < OSAL_NV_PAGES_USED) ? pg : OSAL_NV_PAGE_NULL;
+}
+
 /* redefine the failure case to include debug print output */
 static inline unsigned char NvOperationFailed(void)
 {
@@ -1260,9 +1515,6 @@ static unsigned char osal_nv_item_init( unsigned int id, unsigned int len, void
   }
   else if ((offset = findItem(id, &findPg)) != OSAL_NV_ITEM_NULL)
   {
-    // Re-populate the NV hot item data if the corresponding items are already established.
-    hotItemUpdate(findPg, offset, id);
-
     return NV_SUCCESS;
   }
   else if ( initItem( TRUE, id, len, buf ) != OSAL_NV_PAGE_NULL )
@@ -1289,14 +1541,8 @@ static unsigned int osal_nv_item_len( unsigned int id )
   unsigned char findPg;
   osalNvHdr_t hdr;
   unsigned int offset;
-  unsigned char hotIdx;
 
-  if ((hotIdx = hotItem(id)) < OSAL_NV_MAX_HOT)
-  {
-    findPg = hotPg[hotIdx];
-    offset = hotOff[hotIdx];
-  }
-  else if ((offset = findItem(id, &findPg)) == OSAL_NV_ITEM_NULL)
+  if ((offset = findItem(id, &findPg)) == OSAL_NV_ITEM_NULL)
   {
     return 0;
   }
@@ -1407,7 +1653,7 @@ static unsigned char osal_nv_write( unsigned int id, unsigned int ndx, unsigned
         }
         else
         {
-          hotItemUpdate(dstPg, dstOff+OSAL_NV_HDR_SIZE, hdr.id);
+          indexUpdate(dstPg, dstOff+OSAL_NV_HDR_SIZE, hdr.id);
         }
       }
       else
@@ -1423,6 +1669,7 @@ static unsigned char osal_nv_write( unsigned int id, unsigned int ndx, unsigned
         if ( (srcPg == comPg) && (rtrn == NV_OPER_FAILED) )
         {
           erasePage( pgRes );
+          buildIndex();
         }
         else
         {
@@ -1463,14 +1710,8 @@ static unsigned char osal_nv_read( unsigned int id, unsigned int ndx, unsigned i
   unsigned char *addr, *ptr = (unsigned char *)buf;
   unsigned char findPg;
   unsigned int offset;
-  unsigned char hotIdx;
 
-  if ((hotIdx = hotItem(id)) < OSAL_NV_MAX_HOT)
-  {
-    findPg = hotPg[hotIdx];
-    offset = hotOff[hotIdx];
-  }
-  else if ((offset = findItem(id, &findPg)) == OSAL_NV_ITEM_NULL)
+  if ((offset = findItem(id, &findPg)) == OSAL_NV_ITEM_NULL)
   {
     return NvOperationFailed();
   }
@@ -1621,6 +1862,21 @@ void OsalNvItemInit(unsigned int id, unsigned int len, void *buf )
 }
 
 
+/*
+ * Copy the index lookup counters
+ */
+void OsalNvIndexStatistics( unsigned long *pHits, unsigned long *pMisses, unsigned long *pCompares )
+{
+  xSemaphoreTake(NvalMutex,portMAX_DELAY);
+
+  *pHits = nvIndexHits;
+  *pMisses = nvIndexMisses;
+  *pCompares = nvIndexCompares;
+
+  xSemaphoreGive(NvalMutex);
+}
+
+
 void InitMasterResetKey(void)
 { 
   xSemaphoreTake(NvalMutex,portMAX_DELAY);
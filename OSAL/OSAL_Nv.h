@@ -52,7 +52,10 @@
 // NV page definitions must coincide with segment declaration in "LinkerConfiguration.xcl" file
 #define HAL_NV_PAGE_END            124
 #define HAL_NV_PAGE_CNT            4
+// Watch/HostTest points the NV pages at a RAM array
+#ifndef HAL_NV_PAGE_BEG
 #define HAL_NV_PAGE_BEG           (HAL_NV_PAGE_END-HAL_NV_PAGE_CNT+1)
+#endif
 
 /*********************************************************************
  * MACROS
@@ -101,6 +104,18 @@ unsigned int OsalNvItemLength( unsigned int id );
 
 void OsalNvItemInit( unsigned int id, unsigned int len, void *buf );
 
+/*
+ * Compact an NV page that is nearly full before a write has to
+ */
+unsigned char OsalNvCompactPending( void );
+void OsalNvCompact( void );
+
+/*
+ * Item lookups that were found in the RAM index (hits), that were not
+ * (misses) and the number of index entries compared by the hits
+ */
+void OsalNvIndexStatistics( unsigned long *pHits, unsigned long *pMisses, unsigned long *pCompares );
+
 void WriteMasterResetKey(void);
 
 void PrintNvalSaveError(char *pString);
@@ -57,6 +57,7 @@
 #include "OledDisplay.h"
 #include "Accelerometer.h"
 #include "Calendar.h"
+#include "SerialRam.h"
 
 static void BackgroundTask(void *pvParameters);
 
@@ -119,7 +120,6 @@ static unsigned char RateTestCallback(void);
 #endif
 
 // Alarm -----------------------------------------------------------------------
-static tTimerId AlarmTimerId;
 
 unsigned char nvAlarmOn[10];
 unsigned char currentAlarm = 0;
@@ -127,6 +127,10 @@ unsigned char nvAlarmMinutes[10]; // 10 
 unsigned char nvAlarmHours[10]; // 10 
 
 void GenerateAlarm(void);
+static void AlarmControlHandler(void);
+static void ScheduleNextAlarm(void);
+
+#define MINUTES_PER_DAY ( 24*60 )
 
 #ifdef DIARY
 
@@ -137,7 +141,7 @@ void GenerateAlarm(void);
 
 
 //  DiaryWriteRecord = 0xbd,
-// Options = 0 (3-8  -  )
+// Options: 0-6  -  , 7  = 0
 //       (  )
 // 0 - 
 // 1 - 
@@ -145,7 +149,7 @@ void GenerateAlarm(void);
 // 5, 6 - 
 
 //  DiaryWriteRecord = 0xbd,
-// Options = 1 (3-8  -  )
+// Options: 0-6  -  , 7  = 1
 //     ()
 
 
@@ -171,22 +175,73 @@ typedef struct
 } tDiaryRecord;
 
 
-#define NUMBER_OF_DIARY_RECORDS 10//14
+//      (SerialRam)   ,
+//      .   - 7  Options
+// (DIARY_RECORD_CELL_MASK,   6),
+//    -    
+#define NUMBER_OF_DIARY_RECORDS 128
+#define HEADER_LENGTH_OF_DIARY_RECORDS 5
 #define TEXT_LENGTH_OF_DIARY_RECORDS 20
-unsigned char diary[NUMBER_OF_DIARY_RECORDS][(5 + TEXT_LENGTH_OF_DIARY_RECORDS)];
+#define DIARY_RECORD_SIZE (HEADER_LENGTH_OF_DIARY_RECORDS + TEXT_LENGTH_OF_DIARY_RECORDS)
+static unsigned char diaryRecordsUsed[NUMBER_OF_DIARY_RECORDS / 8];
+
+//   64     128  - ,  
+//   .  ,   ,   
+#define DIARY_RAM_RECORDS 10
+static unsigned char diaryRam[DIARY_RAM_RECORDS][DIARY_RECORD_SIZE];
+
+//     :   ,   .
+//        .
+//      
+static unsigned char diaryBank = 0;
+static unsigned char diarySyncUsed[NUMBER_OF_DIARY_RECORDS / 8];
+static unsigned char diarySyncOpen = 0;
+
+//        ,    
+//   diarySyncUsed.       
+//     :  NV_DIARY_RECORDS -
+//  NV,  -      ( 128 ,  
+// (DIARY_RAM_RECORDS - NV_DIARY_RECORDS) )
+static unsigned int diarySyncTouched = 0; //      
+
+//  NV_DIARY_RECORDS     (OSAL NV), 
+//   ( 8  + ).   NV  - 2 
+//  1,    ,     .  
+//    -      DiaryWriteEndResponse
+#define NV_DIARY_RECORDS 8
+static unsigned char diaryNvChanged = 0; //    
 signed char shownId = -1; //   
 unsigned char alarmRecord = 0; //   !
 unsigned char updateDiaryOnScreen = 0; //   
 
-unsigned char eventIndexes[3]; // 3  ,    
-unsigned char diaryEventStatus[4]; // 0 - ,   3   
-unsigned int  diaryEventYear[4];
-unsigned char diaryEventMonth[4];
-unsigned char diaryEventDay[4];
-unsigned char diaryEventDow[4];
-unsigned char diaryEventHour[4];
-unsigned char diaryEventMin[4];
-unsigned char *diaryEventText[4];
+#define DIARY_STATUS_EMPTY    ( 0 )
+#define DIARY_STATUS_ONCE     ( 1 )
+#define DIARY_STATUS_YEARLY   ( 2 )
+#define DIARY_STATUS_BIRTHDAY ( 3 )
+#define DIARY_STATUS_MONTHLY  ( 4 )
+#define DIARY_STATUS_WEEKLY   ( 5 )
+#define DIARY_STATUS_DAILY    ( 6 )
+
+//           
+#define DIARY_EVENTS_SHOWN ( 3 )
+#define DIARY_MONTHS_AHEAD ( 3 )
+
+//   
+typedef struct
+{
+  unsigned char Index;
+  unsigned int Year;
+  unsigned char Month;
+  unsigned char Day;
+  unsigned char Hour;
+  unsigned char Minute;
+
+} tDiaryEvent;
+
+//    ( )      
+static tDiaryEvent diaryEvents[DIARY_EVENTS_SHOWN];
+static unsigned char diaryEventsCount = 0;
+static unsigned char diarySortDay = 0;
 
 /*
 unsigned char diaryEventStatus = diary[shownId][0] >> 4;
@@ -197,15 +252,19 @@ unsigned char diaryEventDow = (diary[shownId][2] & 0x7);
 unsigned char diaryEventHour = diary[shownId][3];
 unsigned char diaryEventMin = diary[shownId][4];*/
 
-unsigned char distanceToEvent[NUMBER_OF_DIARY_RECORDS]; //       
-
 void ShowDiary();
 static void DiaryWriteRecordHandler(tMessage* pMsg);
 static void DiaryWriteEndHandler();
-static unsigned char  LoadDiaryEvent(unsigned char eventIndex, unsigned int year, 
-                           unsigned char month, unsigned char weekday,
-                           unsigned char day,
-                           unsigned char hour, unsigned char min);
+static void DiarySyncHandler(tMessage* pMsg);
+static void SaveDiary(void);
+static void SendDiaryStatus(void);
+#ifdef DIARY_SYNC_TEST
+static void DiarySyncTest(void);
+#endif
+static unsigned char GetNextDiaryEvent(unsigned char eventIndex,
+                                       unsigned char const* pRecord,
+                                       tDiaryEvent const* pNow,
+                                       tDiaryEvent* pEvent);
 static void SortDiaryEventsOnDate(unsigned int year, unsigned char month, 
                                   unsigned char day, unsigned char hour,
                                   unsigned char min);
@@ -294,18 +353,14 @@ static void BackgroundTask(void *pvParameters)
 
   // Alarm ---------------------------------------------------------------------
   
-  AlarmTimerId = AllocateOneSecondTimer();
-
-  //InitializeBatteryMonitorInterval();
-
-  SetupOneSecondTimer(AlarmTimerId,
-                      ONE_SECOND*5,
-                      REPEAT_FOREVER,
-                      BACKGROUND_QINDEX,
-                      AlarmControl,
-                      NO_MSG_OPTIONS);
-
-  StartOneSecondTimer(AlarmTimerId);
+  /* the alarm task that used to do this is not built, and SaveAlarm needs the
+   * nv items to exist
+   */
+  InitializeAlarm();
+  
+  /* the rtc alarm wakes us up for the next alarm instead of polling */
+  ScheduleNextAlarm();
+  
   // Allocate a timer for wake-up iOS background BLE app
   CallbackTimerId = AllocateOneSecondTimer();
 
@@ -361,12 +416,23 @@ static void BackgroundTask(void *pvParameters)
     if( pdTRUE == xQueueReceive(QueueHandles[BACKGROUND_QINDEX],
                                 &BackgroundMsg, portMAX_DELAY ) )
     {
+      CountReceivedMsg(BACKGROUND_QINDEX,&BackgroundMsg);
+
       PrintMessageType(&BackgroundMsg);
 
       BackgroundMessageHandler(&BackgroundMsg);
 
       SendToFreeQueue(&BackgroundMsg);
 
+      /* make room in nval once the queue is empty so that a later write
+       * does not have to (compaction needs more stack than the idle task has)
+       */
+      if (   uxQueueMessagesWaiting(QueueHandles[BACKGROUND_QINDEX]) == 0
+          && OsalNvCompactPending() )
+      {
+        OsalNvCompact();
+      }
+
       CheckStackUsage(xBkgTaskHandle,"Background Task");
 
       CheckQueueUsage(QueueHandles[BACKGROUND_QINDEX]);
@@ -381,8 +447,6 @@ static void BackgroundTask(void *pvParameters)
 static void BackgroundMessageHandler(tMessage* pMsg)
 {
   tMessage OutgoingMsg;
-      
-  unsigned char doAlarm = 0; // ?    10 ,     
 
   switch(pMsg->Type)
   {
@@ -412,6 +476,7 @@ static void BackgroundMessageHandler(tMessage* pMsg)
 
   case SetRealTimeClock:
     halRtcSet((tRtcHostMsgPayload*)pMsg->pBuffer);
+    ScheduleNextAlarm();
 
 #ifdef DIGITAL
     SetupMessage(&OutgoingMsg,IdleUpdate,NO_MSG_OPTIONS);
@@ -525,8 +590,16 @@ static void BackgroundMessageHandler(tMessage* pMsg)
    *
    */
   case RateTestMsg:
+#if defined(DIARY) && defined(DIARY_SYNC_TEST)
+    DiarySyncTest();
+#endif
     SetupMessageAndAllocateBuffer(&OutgoingMsg,DiagnosticLoopback,NO_MSG_OPTIONS);
     /* don't care what data is */
+#if defined(DIARY) && defined(DIARY_SYNC_TEST)
+    /* except for the time the diary sync took */
+    OutgoingMsg.pBuffer[0] = (unsigned char)gAppStats.DiarySyncTicks;
+    OutgoingMsg.pBuffer[1] = (unsigned char)(gAppStats.DiarySyncTicks >> 8);
+#endif
     OutgoingMsg.Length = 10;
     RouteMsg(&OutgoingMsg);
     break;
@@ -557,21 +630,7 @@ static void BackgroundMessageHandler(tMessage* pMsg)
       }
     }
 #endif          
-    //  
-    for(unsigned char i = 0; i < 10; i++)
-    {
-      if(nvAlarmOn[i] == 0)
-        continue;
-      
-      if(RTCHOUR == nvAlarmHours[i] && RTCMIN == nvAlarmMinutes[i])
-      {
-        //  
-        nvAlarmOn[i] = 0;
-        doAlarm = 1;
-      }
-    }
-    if(doAlarm == 1)
-      GenerateAlarm();
+    AlarmControlHandler();
     break;
 #ifdef DIARY
   case DiaryWriteRecord:
@@ -580,6 +639,12 @@ static void BackgroundMessageHandler(tMessage* pMsg)
   case DiaryWriteEnd:
     DiaryWriteEndHandler();
     break;
+  case DiarySyncMsg:
+    DiarySyncHandler(pMsg);
+    break;
+  case ShowDiaryMsg:
+    ShowDiary();
+    break;
 #endif
   /*
    *
@@ -593,19 +658,230 @@ static void BackgroundMessageHandler(tMessage* pMsg)
 
 #ifdef DIARY
 
+//     ,   .
+//      ShowDiaryMsg
 void ShowDiary()
 {
   SortDiaryEventsOnDate(RTCYEAR, RTCMON, RTCDAY, RTCHOUR, RTCMIN);
   updateDiaryOnScreen = 1;
 }
 
-// RTCYEAR RTCMON  RTCDOW RTCDAY
-//     ,  1
-// hour, min -      
-static unsigned char  LoadDiaryEvent(unsigned char eventIndex, unsigned int year, 
-                           unsigned char month, unsigned char weekday,
-                           unsigned char day,
-                           unsigned char hour, unsigned char min)
+//     ,   
+static void RequestDiarySort(void)
+{
+  tMessage Msg;
+  
+  SetupMessage(&Msg, ShowDiaryMsg, NO_MSG_OPTIONS);
+  RouteMsg(&Msg);
+}
+
+static unsigned long GetDiaryEventKey(tDiaryEvent const* pEvent)
+{
+  return ((unsigned long)pEvent->Year << 20) | ((unsigned long)pEvent->Month << 16)
+         | ((unsigned int)pEvent->Day << 11) | ((unsigned int)pEvent->Hour << 6)
+         | pEvent->Minute;
+}
+
+static unsigned int GetDiaryRecordYear(unsigned char const* pRecord)
+{
+  return 1900 + (((pRecord[0] & 0x7) << 4) | (pRecord[1] >> 4));
+}
+
+static unsigned char IsDiaryInRam(void)
+{
+  return GetSerialRamStorageSize() / DIARY_RECORD_SIZE / 2 < DIARY_RAM_RECORDS;
+}
+
+//    
+static unsigned char GetDiaryCapacity(void)
+{
+  unsigned int capacity = GetSerialRamStorageSize() / DIARY_RECORD_SIZE / 2;
+  
+  if(IsDiaryInRam())
+    return DIARY_RAM_RECORDS;
+  
+  return (capacity < NUMBER_OF_DIARY_RECORDS) ? capacity : NUMBER_OF_DIARY_RECORDS;
+}
+
+// ,    (   )
+static unsigned char GetDiarySyncBank(void)
+{
+  return IsDiaryInRam() ? diaryBank : diaryBank ^ 1;
+}
+
+// offset -   
+static void ReadDiaryRecord(unsigned char bank, unsigned char eventIndex,
+                            unsigned char offset, unsigned char* pData,
+                            unsigned char size)
+{
+  if(IsDiaryInRam())
+  {
+    //    ,    
+    portENTER_CRITICAL();
+    memcpy(pData, &diaryRam[eventIndex][offset], size);
+    portEXIT_CRITICAL();
+  }
+  else
+  {
+    ReadSerialRamStorage(((unsigned int)bank * GetDiaryCapacity() + eventIndex) * DIARY_RECORD_SIZE + offset,
+                         pData, size);
+  }
+}
+
+static void WriteDiaryRecord(unsigned char bank, unsigned char eventIndex,
+                             unsigned char offset, unsigned char const* pData,
+                             unsigned char size)
+{
+  if(IsDiaryInRam())
+  {
+    portENTER_CRITICAL();
+    memcpy(&diaryRam[eventIndex][offset], pData, size);
+    portEXIT_CRITICAL();
+  }
+  else
+  {
+    WriteSerialRamStorage(((unsigned int)bank * GetDiaryCapacity() + eventIndex) * DIARY_RECORD_SIZE + offset,
+                          pData, size);
+  }
+}
+
+//   NV  ,    
+static void LoadDiaryRecord(unsigned char eventIndex, unsigned char* pRecord)
+{
+  // ,   ,  NV  
+  if(   eventIndex >= NV_DIARY_RECORDS
+     || OsalNvItemLength(NVID_DIARY_RECORD + eventIndex) != DIARY_RECORD_SIZE
+     || OsalNvRead(NVID_DIARY_RECORD + eventIndex, NV_ZERO_OFFSET, DIARY_RECORD_SIZE, pRecord) != NV_SUCCESS
+     || (pRecord[0] >> 5) == DIARY_STATUS_EMPTY)
+  {
+    memset(pRecord, 0, DIARY_RECORD_SIZE);
+  }
+}
+
+static unsigned char IsDiarySyncTouched(unsigned char eventIndex)
+{
+  return eventIndex < DIARY_RAM_RECORDS && (diarySyncTouched & (1 << eventIndex));
+}
+
+//       
+static void ReadDiarySyncUndo(unsigned char eventIndex, unsigned char* pRecord)
+{
+  if(eventIndex < NV_DIARY_RECORDS)
+  {
+    LoadDiaryRecord(eventIndex, pRecord);
+  }
+  else
+  {
+    ReadSerialRamStorage((eventIndex - NV_DIARY_RECORDS) * DIARY_RECORD_SIZE,
+                         pRecord, DIARY_RECORD_SIZE);
+  }
+}
+
+//  : pRecord -   , size -  
+static void ReadShownDiaryRecord(unsigned char bank, unsigned char eventIndex,
+                                 unsigned char* pRecord, unsigned char size)
+{
+  if(IsDiarySyncTouched(eventIndex))
+  {
+    ReadDiarySyncUndo(eventIndex, pRecord);
+  }
+  else
+  {
+    ReadDiaryRecord(bank, eventIndex, 0, pRecord, size);
+  }
+}
+
+//        
+static void TouchDiarySyncRecord(unsigned char eventIndex)
+{
+  unsigned char record[DIARY_RECORD_SIZE];
+  
+  if(IsDiaryInRam() == 0 || IsDiarySyncTouched(eventIndex))
+    return;
+  
+  if(eventIndex >= NV_DIARY_RECORDS)
+  {
+    ReadDiaryRecord(diaryBank, eventIndex, 0, record, DIARY_RECORD_SIZE);
+    WriteSerialRamStorage((eventIndex - NV_DIARY_RECORDS) * DIARY_RECORD_SIZE,
+                          record, DIARY_RECORD_SIZE);
+  }
+  
+  diarySyncTouched |= 1 << eventIndex;
+}
+
+static void CancelDiarySync(void)
+{
+  unsigned char record[DIARY_RECORD_SIZE];
+  
+  for(unsigned char i = 0; i < DIARY_RAM_RECORDS; i++)
+  {
+    if(IsDiarySyncTouched(i) == 0)
+      continue;
+    
+    ReadDiarySyncUndo(i, record);
+    WriteDiaryRecord(diaryBank, i, 0, record, DIARY_RECORD_SIZE);
+  }
+  
+  diarySyncTouched = 0;
+  diarySyncOpen = 0;
+}
+
+static unsigned char IsDiaryRecordUsed(unsigned char eventIndex)
+{
+  return diaryRecordsUsed[eventIndex >> 3] & (1 << (eventIndex & 0x7));
+}
+
+static void SetDiaryRecordUsed(unsigned char eventIndex, unsigned char status)
+{
+  unsigned char mask = 1 << (eventIndex & 0x7);
+  
+  if(eventIndex < NV_DIARY_RECORDS)
+  {
+    diaryNvChanged |= 1 << eventIndex;
+  }
+  
+  if(status == DIARY_STATUS_EMPTY)
+  {
+    diaryRecordsUsed[eventIndex >> 3] &= ~mask;
+  }
+  else
+  {
+    diaryRecordsUsed[eventIndex >> 3] |= mask;
+  }
+}
+
+static void AddDiaryMonth(tDiaryEvent* pEvent)
+{
+  if(pEvent->Month >= 12)
+  {
+    pEvent->Month = 1;
+    pEvent->Year++;
+  }
+  else
+  {
+    pEvent->Month++;
+  }
+}
+
+static void AddDiaryDays(tDiaryEvent* pEvent, unsigned char days)
+{
+  for( ; days > 0; days--)
+  {
+    pEvent->Day++;
+    if(pEvent->Day > daysInMonth(pEvent->Month, pEvent->Year))
+    {
+      pEvent->Day = 1;
+      AddDiaryMonth(pEvent);
+    }
+  }
+}
+
+//       (  pNow)
+//  0 -      
+static unsigned char GetNextDiaryEvent(unsigned char eventIndex,
+                                       unsigned char const* pRecord,
+                                       tDiaryEvent const* pNow,
+                                       tDiaryEvent* pEvent)
 {
   // NUMBER_OF_DIARY_RECORDS   32 
         // 0  -  (3)  0 -   1 -  2 -  
@@ -617,157 +893,173 @@ static unsigned char  LoadDiaryEvent(unsigned char eventIndex, unsigned int year
         //         (3)
         // 1,2 -  - [(4  1900 ), (4 )], [(5)  (3 )]
         // 3,4 - 
-        diaryEventStatus[0] = diary[eventIndex][0] >> 5;
-        if(diaryEventStatus[0] == 0)
-        {
-          return 0;
-        }
-        
-        int tempYear = 1900 + ((diary[eventIndex][0] & 0x7) << 4) | (diary[eventIndex][1] >> 4);
-        diaryEventYear[0] = tempYear;
-        diaryEventMonth[0] = diary[eventIndex][1] & 0xf;
-        diaryEventDay[0] = (diary[eventIndex][2] >> 3);
-        diaryEventDow[0] = (diary[eventIndex][2] & 0x7);
-        diaryEventHour[0] = diary[eventIndex][3];
-        diaryEventMin[0] = diary[eventIndex][4];
-        diaryEventText[0] = &(diary[eventIndex][5]);
-        
-        //  ,    
-        if(diaryEventStatus[0] >= 2 && diaryEventStatus[0] <= 6)
-        {
-          diaryEventYear[0] = year;
-        }
-        //   ,    ,   
-        if(diaryEventStatus[0] >= 4 && diaryEventStatus[0] <= 6)
-        {
-          diaryEventMonth[0] = month;
-        }
-        //        ,   
-        if(diaryEventStatus[0] == 5)
-        {
-          if(diaryEventDow[0] == weekday)
-            diaryEventDay[0] == day;
-        }
-        //    ,   
-        if(diaryEventStatus[0] == 6)
-        {
-          diaryEventDay[0] == day;
-        }
-        if(diaryEventYear[0] == year && diaryEventMonth[0] == month
-           && diaryEventDay[0] == day && diaryEventHour[0])
-        {
-          if(diaryEventHour[0] > hour || (diaryEventHour[0] == hour && diaryEventMin[0] >= min))
-          {
-            if(diaryEventStatus[0] == 3) //   -  
-            { //    
-              diaryEventYear[0] = tempYear;
-            }
-            return 1;
-          }
-          else
-            return 0;
-        }
-        else return 0;
+  unsigned char status = pRecord[0] >> 5;
+  unsigned char dow = pRecord[2] & 0x7;
+  unsigned char days;
+  unsigned char i;
+  
+  pEvent->Index = eventIndex;
+  pEvent->Year = GetDiaryRecordYear(pRecord);
+  pEvent->Month = pRecord[1] & 0xf;
+  pEvent->Day = pRecord[2] >> 3;
+  pEvent->Hour = pRecord[3];
+  pEvent->Minute = pRecord[4];
+  
+  //     
+  unsigned char passed = (pEvent->Hour < pNow->Hour 
+                          || (pEvent->Hour == pNow->Hour && pEvent->Minute < pNow->Minute));
+  
+  switch(status)
+  {
+  case DIARY_STATUS_ONCE:
+    break;
+    
+  case DIARY_STATUS_YEARLY:
+  case DIARY_STATUS_BIRTHDAY:
+    pEvent->Year = pNow->Year;
+    if(GetDiaryEventKey(pEvent) < GetDiaryEventKey(pNow))
+    {
+      pEvent->Year++;
+    }
+    // 29 
+    for(i = 0; i < 8 && pEvent->Day > daysInMonth(pEvent->Month, pEvent->Year); i++)
+    {
+      pEvent->Year++;
+    }
+    break;
+    
+  case DIARY_STATUS_MONTHLY:
+    pEvent->Year = pNow->Year;
+    pEvent->Month = pNow->Month;
+    if(pEvent->Day < pNow->Day || (pEvent->Day == pNow->Day && passed))
+    {
+      AddDiaryMonth(pEvent);
+    }
+    for(i = 0; i < 12 && pEvent->Day > daysInMonth(pEvent->Month, pEvent->Year); i++)
+    {
+      AddDiaryMonth(pEvent);
+    }
+    break;
+    
+  case DIARY_STATUS_WEEKLY:
+  case DIARY_STATUS_DAILY:
+    days = 0;
+    if(status == DIARY_STATUS_WEEKLY)
+    {
+      days = (dow + 7 - dayOfWeek2(pNow->Day, pNow->Month, pNow->Year)) % 7;
+    }
+    if(days == 0 && passed)
+    {
+      days = (status == DIARY_STATUS_WEEKLY) ? 7 : 1;
+    }
+    pEvent->Year = pNow->Year;
+    pEvent->Month = pNow->Month;
+    pEvent->Day = pNow->Day;
+    AddDiaryDays(pEvent, days);
+    break;
+    
+  default:
+    return 0;
+  }
+  
+  if(pEvent->Day == 0 || pEvent->Day > daysInMonth(pEvent->Month, pEvent->Year))
+  {
+    return 0;
+  }
+  
+  return GetDiaryEventKey(pEvent) >= GetDiaryEventKey(pNow);
 }
 
 
+//      DIARY_MONTHS_AHEAD 
 static void SortDiaryEventsOnDate(unsigned int year, unsigned char month, 
                                   unsigned char day, unsigned char hour,
                                   unsigned char min)
 {
-  //    3 
-  for(unsigned char i = 0; i < 3; i++)
+  tDiaryEvent now;
+  tDiaryEvent last;
+  tDiaryEvent event;
+  tDiaryEvent events[DIARY_EVENTS_SHOWN];
+  unsigned char count = 0;
+  unsigned long key;
+  unsigned char record[DIARY_RECORD_SIZE];
+  unsigned char capacity = GetDiaryCapacity();
+  
+  now.Year = year;
+  now.Month = month;
+  now.Day = day;
+  now.Hour = hour;
+  now.Minute = min;
+  
+  //  ,    
+  last = now;
+  for(unsigned char i = 0; i < DIARY_MONTHS_AHEAD; i++)
   {
-    diaryEventYear[i + 1] = 0;
-    eventIndexes[i] = 0;
+    AddDiaryMonth(&last);
   }
-  unsigned int curYear = RTCYEAR;
-  unsigned char curMonth = RTCMON,
-                
-                startDay = RTCDAY,
-                startHour = hour,
-                startMin = min;
+  last.Day = 31;
+  last.Hour = 23;
+  last.Minute = 59;
   
-  for(unsigned char month = 0; month <= 3; month++)
+  for(unsigned char i = 0; i < capacity; i++)
   {
-    //    
-    unsigned char days = daysInMonth(curMonth, curYear);
-    for(unsigned char day = startDay; day <= days; day++)
+    if(IsDiaryRecordUsed(i) == 0)
+      continue;
+    
+    //      
+    ReadShownDiaryRecord(diaryBank, i, record, HEADER_LENGTH_OF_DIARY_RECORDS);
+    if(GetNextDiaryEvent(i, record, &now, &event) == 0)
+      continue;
+    
+    key = GetDiaryEventKey(&event);
+    if(key > GetDiaryEventKey(&last))
+      continue;
+    
+    //    ,   
+    unsigned char j = count;
+    while(j > 0 && GetDiaryEventKey(&events[j - 1]) > key)
     {
-      //   
-      unsigned char curDOW = dayOfWeek2(day, curMonth, curYear);
-      for(unsigned char i = 0; i < NUMBER_OF_DIARY_RECORDS; i++)
+      if(j < DIARY_EVENTS_SHOWN)
       {
-        if(LoadDiaryEvent(i, curYear, curMonth, curDOW, day, startHour, startMin) == 1)
-        {
-          for(unsigned char j = 0; j < 3; j++)
-          {
-            //    , !
-            if(diaryEventYear[j + 1] == 0)
-            {
-              diaryEventYear[j + 1] = diaryEventYear[0];
-              diaryEventMonth[j + 1] = diaryEventMonth[0];
-              diaryEventDay[j + 1] = diaryEventDay[0];
-              eventIndexes[j] = i;
-              break;
-            }
-            else
-            {
-              //   ,  ,       
-              if(diaryEventYear[0] < diaryEventYear[j + 1] 
-                 || (diaryEventYear[0] == diaryEventYear[j + 1] && diaryEventMonth[0] < diaryEventMonth[j + 1])
-                 || (diaryEventYear[0] == diaryEventYear[j + 1] && diaryEventMonth[0] == diaryEventMonth[j + 1] && diaryEventDay[0] < diaryEventDay[j + 1]))
-              {
-                if(j < 2) //   
-                {
-                  for(unsigned char k = 2; k > j; k--)
-                  {
-                    diaryEventYear[k + 1] = diaryEventYear[k + 1 - 1];
-                    diaryEventMonth[k + 1] = diaryEventMonth[k + 1 - 1];
-                    diaryEventDay[k + 1] = diaryEventDay[k + 1 - 1];
-                    eventIndexes[k] = eventIndexes[k - 1];
-                  }
-                }
-                //     
-                diaryEventYear[j + 1] = diaryEventYear[0];
-                diaryEventMonth[j + 1] = diaryEventMonth[0];
-                diaryEventDay[j + 1] = diaryEventDay[0];
-                eventIndexes[j] = i;
-              }
-            }
-          }
-        }
-                 
+        events[j] = events[j - 1];
       }
-      //        0,  
-      if(diaryEventYear[3] > 0)
-        return;
-      
-      //     ,      
-      startHour = 0;
-      startMin = 0;
-    } // day
-    if(curMonth == 12)
-    {
-      curYear++;
-      curMonth = 1;
+      j--;
     }
-    else
+    
+    if(j < DIARY_EVENTS_SHOWN)
     {
-      curMonth++;
+      events[j] = event;
+      if(count < DIARY_EVENTS_SHOWN)
+      {
+        count++;
+      }
     }
-    startDay = 1;
-  } // month
-    
+  }
+  
+  //        
+  portENTER_CRITICAL();
+  memcpy(diaryEvents, events, sizeof(diaryEvents));
+  diaryEventsCount = count;
+  diarySortDay = day;
+  portEXIT_CRITICAL();
 }
 
 static void DiaryWriteRecordHandler(tMessage* pMsg)
 {
-  unsigned char recordId = pMsg->Options & 0x3f;
-  if(recordId >= NUMBER_OF_DIARY_RECORDS)
+  unsigned char recordId = pMsg->Options & DIARY_RECORD_CELL_MASK;
+  unsigned char record[DIARY_RECORD_SIZE];
+  
+  if(recordId >= GetDiaryCapacity())
     return;
+  
+  //          -   ,
+  //        
+  if(diarySyncOpen && IsDiaryInRam())
+  {
+    CancelDiarySync();
+  }
   //  
-  if((pMsg->Options & 0x80) == 0)
+  if((pMsg->Options & DIARY_RECORD_TEXT_OPTION) == 0)
   {
          // 0  -  (3)  0 -   1 -  2 -  
         //                      3 -  
@@ -780,31 +1072,344 @@ static void DiaryWriteRecordHandler(tMessage* pMsg)
         // 3,4 - 
     
     tDiaryRecord* pDiaryRecord = (tDiaryRecord*)pMsg->pBuffer;
-    diary[recordId][0] = (pDiaryRecord->Status << 5) | (pDiaryRecord->Alarm << 3)
+    record[0] = (pDiaryRecord->Status << 5) | (pDiaryRecord->Alarm << 3)
                                 | (pDiaryRecord->Year >> 4);
-    diary[recordId][1] = (pDiaryRecord->Year << 4) | pDiaryRecord->Month;
-    diary[recordId][2] = (pDiaryRecord->Day << 3) | pDiaryRecord->DayOfWeek;
-    diary[recordId][3] = pDiaryRecord->Hour;
-    diary[recordId][4] = pDiaryRecord->Minute;
+    record[1] = (pDiaryRecord->Year << 4) | pDiaryRecord->Month;
+    record[2] = (pDiaryRecord->Day << 3) | pDiaryRecord->DayOfWeek;
+    record[3] = pDiaryRecord->Hour;
+    record[4] = pDiaryRecord->Minute;
+    
+    //    -     . 
+    //     ,     
+    if(pDiaryRecord->Status == DIARY_STATUS_EMPTY)
+    {
+      memset(record + HEADER_LENGTH_OF_DIARY_RECORDS, 0, TEXT_LENGTH_OF_DIARY_RECORDS);
+      WriteDiaryRecord(diaryBank, recordId, 0, record, DIARY_RECORD_SIZE);
+    }
+    else
+    {
+      WriteDiaryRecord(diaryBank, recordId, 0, record, HEADER_LENGTH_OF_DIARY_RECORDS);
+    }
+    
+    SetDiaryRecordUsed(recordId, pDiaryRecord->Status);
   }
   else // 
   {
-    for(unsigned char i = 0; i < TEXT_LENGTH_OF_DIARY_RECORDS; i++)
+    WriteDiaryRecord(diaryBank, recordId, HEADER_LENGTH_OF_DIARY_RECORDS,
+                     pMsg->pBuffer, TEXT_LENGTH_OF_DIARY_RECORDS);
+    if(recordId < NV_DIARY_RECORDS)
     {
-      diary[recordId][5 + i] = pMsg->pBuffer[i];
+      diaryNvChanged |= 1 << recordId;
     }
   }
-  updateDiaryOnScreen = 1;
+  
+  //        
+  RequestDiarySort();
 }
 
 static void DiaryWriteEndHandler()
 {
+  SaveDiary();
   ShowDiary();
+  SendDiaryStatus();
+}
+
+//    ,      
+static void SendDiaryStatus(void)
+{
+  tMessage OutgoingMsg;
+  tDiaryStatusPayload* pPayload;
+  unsigned char capacity = GetDiaryCapacity();
+  unsigned char used = 0;
+  unsigned char volatileCells = 0;
+  
+  for(unsigned char i = 0; i < capacity; i++)
+  {
+    if(IsDiaryRecordUsed(i) == 0)
+      continue;
+    
+    used++;
+    if(i >= NV_DIARY_RECORDS)
+    {
+      volatileCells++;
+    }
+  }
+  
+  SetupMessageAndAllocateBuffer(&OutgoingMsg,
+                                DiaryWriteEndResponse,
+                                NO_MSG_OPTIONS);
+  
+  pPayload = (tDiaryStatusPayload*)OutgoingMsg.pBuffer;
+  pPayload->Capacity = capacity;
+  pPayload->PersistentCells = (capacity < NV_DIARY_RECORDS) ? capacity : NV_DIARY_RECORDS;
+  pPayload->UsedCells = used;
+  pPayload->VolatileCells = volatileCells;
+  
+  OutgoingMsg.Length = sizeof(tDiaryStatusPayload);
+  RouteMsg(&OutgoingMsg);
+}
+
+void InitializeDiary(void)
+{
+  unsigned char record[DIARY_RECORD_SIZE];
+  unsigned char capacity = GetDiaryCapacity();
+  
+  //     ,      
+  for(unsigned char i = 0; i < capacity; i++)
+  {
+    LoadDiaryRecord(i, record);
+    WriteDiaryRecord(diaryBank, i, 0, record, DIARY_RECORD_SIZE);
+    SetDiaryRecordUsed(i, record[0] >> 5);
+  }
+  
+  diaryNvChanged = 0;
+}
+
+//       (NV     )
+static void SaveDiary(void)
+{
+  unsigned char record[DIARY_RECORD_SIZE];
+  
+  for(unsigned char i = 0; i < NV_DIARY_RECORDS; i++)
+  {
+    if((diaryNvChanged & (1 << i)) == 0)
+      continue;
+    
+    if(IsDiaryRecordUsed(i))
+    {
+      ReadDiaryRecord(diaryBank, i, 0, record, DIARY_RECORD_SIZE);
+    }
+    else
+    {
+      memset(record, 0, DIARY_RECORD_SIZE);
+    }
+    
+    if(OsalNvItemLength(NVID_DIARY_RECORD + i) == DIARY_RECORD_SIZE)
+    {
+      OsalNvWrite(NVID_DIARY_RECORD + i, NV_ZERO_OFFSET, DIARY_RECORD_SIZE, record);
+    }
+    else if(IsDiaryRecordUsed(i))
+    {
+      //       
+      OsalNvItemInit(NVID_DIARY_RECORD + i, DIARY_RECORD_SIZE, record);
+    }
+  }
+  
+  diaryNvChanged = 0;
+}
+
+//    :  , ,   0 
+//   .  -     0,    
+//   
+static unsigned char ParseDiarySyncRecord(unsigned char const* pPayload,
+                                          unsigned char pos,
+                                          unsigned char* pRecord)
+{
+  unsigned char length = 0;
+  unsigned char c;
+  
+  if(pos + 1 + HEADER_LENGTH_OF_DIARY_RECORDS > HOST_MSG_MAX_PAYLOAD_LENGTH)
+    return 0;
+  
+  pos++;
+  memcpy(pRecord, &pPayload[pos], HEADER_LENGTH_OF_DIARY_RECORDS);
+  pos += HEADER_LENGTH_OF_DIARY_RECORDS;
+  
+  while(length < TEXT_LENGTH_OF_DIARY_RECORDS)
+  {
+    if(pos >= HOST_MSG_MAX_PAYLOAD_LENGTH)
+      return 0;
+    
+    c = pPayload[pos++];
+    if(c == 0)
+      break;
+    pRecord[HEADER_LENGTH_OF_DIARY_RECORDS + length++] = c;
+  }
+  memset(pRecord + HEADER_LENGTH_OF_DIARY_RECORDS + length, 0,
+         TEXT_LENGTH_OF_DIARY_RECORDS - length);
+  
+  return pos;
+}
+
+//    ,    
+// DIARY_SYNC_NO_RECORD.        ,
+//    
+static unsigned char IsDiarySyncPacketValid(unsigned char const* pPayload)
+{
+  unsigned char record[DIARY_RECORD_SIZE];
+  unsigned char pos = 0;
+  unsigned char next;
+  
+  while(pos < HOST_MSG_MAX_PAYLOAD_LENGTH)
+  {
+    if(pPayload[pos] == DIARY_SYNC_NO_RECORD)
+      return 1;
+    
+    next = ParseDiarySyncRecord(pPayload, pos, record);
+    if(next == 0)
+      return 0;
+    
+    if(next == HOST_MSG_MAX_PAYLOAD_LENGTH)
+      return pos == 0;
+    
+    pos = next;
+  }
+  
+  return 0;
+}
+
+//  -  .     ,  
+//      ,   -  
+//  .   ,   .
+//    ()     
+static void DiarySyncHandler(tMessage* pMsg)
+{
+  static portTickType syncStartTick;
+  unsigned char record[DIARY_RECORD_SIZE];
+  unsigned char capacity = GetDiaryCapacity();
+  unsigned char syncBank = GetDiarySyncBank();
+  unsigned char pos = 0;
+  unsigned char recordId;
+  
+  if(pMsg->Options & DIARY_SYNC_CLEAR_OPTION)
+  {
+    if(diarySyncOpen)
+    {
+      CancelDiarySync();
+    }
+    
+    if(IsDiaryInRam())
+    {
+      //        NV
+      SaveDiary();
+    }
+    else
+    {
+      // ,    ,   -   
+      memset(record, 0, DIARY_RECORD_SIZE);
+      for(unsigned char i = 0; i < capacity; i++)
+      {
+        WriteDiaryRecord(syncBank, i, 0, record, DIARY_RECORD_SIZE);
+      }
+    }
+    memset(diarySyncUsed, 0, sizeof(diarySyncUsed));
+    diarySyncOpen = 1;
+    syncStartTick = xTaskGetTickCount();
+  }
+  
+  //     
+  if(diarySyncOpen == 0)
+    return;
+  
+  //     
+  if(IsDiarySyncPacketValid(pMsg->pBuffer) == 0)
+  {
+    PrintString("Diary sync packet without end\r\n");
+    CancelDiarySync();
+    return;
+  }
+  
+  while(pos < HOST_MSG_MAX_PAYLOAD_LENGTH)
+  {
+    recordId = pMsg->pBuffer[pos];
+    if(recordId == DIARY_SYNC_NO_RECORD)
+      break;
+    
+    pos = ParseDiarySyncRecord(pMsg->pBuffer, pos, record);
+    
+    if(recordId >= capacity)
+      continue;
+    
+    if((record[0] >> 5) == DIARY_STATUS_EMPTY)
+    {
+      memset(record, 0, DIARY_RECORD_SIZE);
+    }
+    
+    TouchDiarySyncRecord(recordId);
+    WriteDiaryRecord(syncBank, recordId, 0, record, DIARY_RECORD_SIZE);
+    if((record[0] >> 5) == DIARY_STATUS_EMPTY)
+    {
+      diarySyncUsed[recordId >> 3] &= ~(1 << (recordId & 0x7));
+    }
+    else
+    {
+      diarySyncUsed[recordId >> 3] |= 1 << (recordId & 0x7);
+    }
+  }
+  
+  if(pMsg->Options & DIARY_SYNC_END_OPTION)
+  {
+    //       
+    portENTER_CRITICAL();
+    diaryBank = syncBank;
+    memcpy(diaryRecordsUsed, diarySyncUsed, sizeof(diaryRecordsUsed));
+    diarySyncTouched = 0;
+    diaryEventsCount = 0;
+    portEXIT_CRITICAL();
+    
+    //    ,    ,  
+    if(IsDiaryInRam())
+    {
+      memset(record, 0, DIARY_RECORD_SIZE);
+      for(unsigned char i = 0; i < capacity; i++)
+      {
+        if(IsDiaryRecordUsed(i) == 0)
+        {
+          WriteDiaryRecord(diaryBank, i, 0, record, DIARY_RECORD_SIZE);
+        }
+      }
+    }
+    
+    diarySyncOpen = 0;
+    diaryNvChanged = (1 << NV_DIARY_RECORDS) - 1;
+    SaveDiary();
+    gAppStats.DiarySyncTicks = xTaskGetTickCount() - syncStartTick;
+    ShowDiary();
+    SendDiaryStatus();
+  }
 }
 
+#ifdef DIARY_SYNC_TEST
+//    ,    
+// (    -    )
+static void DiarySyncTest(void)
+{
+  unsigned char buffer[HOST_MSG_MAX_PAYLOAD_LENGTH];
+  unsigned char capacity = GetDiaryCapacity();
+  tMessage Msg;
+  
+  SetupMessage(&Msg, DiarySyncMsg, NO_MSG_OPTIONS);
+  Msg.pBuffer = buffer;
+  
+  for(unsigned char i = 0; i < capacity; i++)
+  {
+    Msg.Options = 0;
+    if(i == 0)
+    {
+      Msg.Options |= DIARY_SYNC_CLEAR_OPTION;
+    }
+    if(i == capacity - 1)
+    {
+      Msg.Options |= DIARY_SYNC_END_OPTION;
+    }
+    
+    //    0:00 + i ,  1  2012 
+    buffer[0] = i;
+    buffer[1] = (DIARY_STATUS_DAILY << 5) | (112 >> 4);
+    buffer[2] = (112 << 4) | 1;
+    buffer[3] = (1 << 3) | 1;
+    buffer[4] = i / 60;
+    buffer[5] = i % 60;
+    memset(&buffer[1 + HEADER_LENGTH_OF_DIARY_RECORDS], 'A' + i % 26,
+           TEXT_LENGTH_OF_DIARY_RECORDS);
+    
+    DiarySyncHandler(&Msg);
+  }
+}
+#endif
+
 unsigned char IsUpdateDiary()
 {
-  return 1;//   
   unsigned char updateDiaryOnScreenValue = updateDiaryOnScreen;
   updateDiaryOnScreen = 0;
   return updateDiaryOnScreenValue;
@@ -817,20 +1422,42 @@ unsigned char GetDiaryDataStrings(unsigned char index, char *string0, char *stri
 {
 //  char *tudayString = "";
 //  char *nowString = "";
-  if(diaryEventYear[index + 1] == 0)
+
+  //   -     ,
+  //     
+  if(diarySortDay != RTCDAY)
+  {
+    RequestDiarySort();
+  }
+  
+  if(index >= DIARY_EVENTS_SHOWN)
      return 0;
   
-  //!!!!eventIndexes[index]
-  unsigned char today = LoadDiaryEvent(eventIndexes[index], RTCYEAR, RTCMON, RTCDAY, RTCDOW, RTCHOUR, RTCMIN);
-    //LoadDiaryEvent(index);
-    //if(diaryEventStatus == 0)
-      //return;
+  tDiaryEvent event;
+  unsigned char count;
+  unsigned char bank;
   
+  portENTER_CRITICAL();
+  event = diaryEvents[index];
+  count = diaryEventsCount;
+  bank = diaryBank;
+  portEXIT_CRITICAL();
   
+  //   ,     
+  if(index >= count || IsDiaryRecordUsed(event.Index) == 0)
+     return 0;
+  
+  tDiaryEvent* pEvent = &event;
+  unsigned char record[DIARY_RECORD_SIZE];
+  unsigned char today = (pEvent->Year == RTCYEAR && pEvent->Month == RTCMON 
+                         && pEvent->Day == RTCDAY);
   
     memset(string0, 0x20, 20);
     memset(string1, 0x0, 20);
     
+    //      
+    ReadShownDiaryRecord(bank, pEvent->Index, record, DIARY_RECORD_SIZE);
+    
     unsigned char curPos;
     if(today == 1)
     {
@@ -839,24 +1466,29 @@ unsigned char GetDiaryDataStrings(unsigned char index, char *string0, char *stri
     }
     else
     {
+      unsigned int year = pEvent->Year;
+      
+      //      
+      if((record[0] >> 5) == DIARY_STATUS_BIRTHDAY)
+      {
+        year = GetDiaryRecordYear(record);
+      }
       
-      itoa(diaryEventDay[0], string0, 2);
+      itoa(pEvent->Day, string0, 2);
       string0[2] = '.';
-      itoa(diaryEventMonth[0], string0 + 3, 2);
+      itoa(pEvent->Month, string0 + 3, 2);
       string0[5] = '.';
-      itoa(diaryEventYear[0], string0 + 6, 4);
+      itoa(year, string0 + 6, 4);
       
       curPos = 11;
     }
     
-    //if(
-    
     unsigned char len;
-    len = itoa(diaryEventHour[0], string0 + curPos, 0);
+    len = itoa(pEvent->Hour, string0 + curPos, 0);
     string0[curPos + len] = ':';
-    itoa(diaryEventMin[0], string0 + curPos + len + 1, 2);
+    itoa(pEvent->Minute, string0 + curPos + len + 1, 2);
     
-    mystrncpy(diaryEventText[0], 20, string1);
+    mystrncpy((char*)&record[HEADER_LENGTH_OF_DIARY_RECORDS], TEXT_LENGTH_OF_DIARY_RECORDS, string1);
 
     return 1;
 
@@ -1081,16 +1713,16 @@ static void InitializeBatteryMonitorInterval(void)
 
 }
 
-/* choose whether or not to do a master reset (reset non-volatile values) */
+/* choose whether or not to do a master reset (reset non-volatile values)
+ *
+ * The menu settings are cached by the display task, so it commits them and
+ * does the reset.  Saving them from here would race with the menu.
+ */
 static void SoftwareResetHandler(tMessage* pMsg)
 {
-  if ( pMsg->Options == MASTER_RESET_OPTION )
-  {
-    WriteMasterResetKey();
-  }
-
-  SoftwareReset();
-
+  tMessage Msg;
+  SetupMessage(&Msg,SaveSettingsAndResetMsg,pMsg->Options);
+  RouteMsg(&Msg);
 }
 
 static void NvalOperationHandler(tMessage* pMsg)
@@ -1148,6 +1780,23 @@ static void NvalOperationHandler(tMessage* pMsg)
     NvUpdater(pNvPayload->NvalIdentifier);
     break;
 
+  case NVAL_STATISTICS_OPERATION:
+    {
+      unsigned long Counters[3];
+      unsigned char i;
+
+      OsalNvIndexStatistics(&Counters[0],&Counters[1],&Counters[2]);
+
+      for ( i = 0; i < 4*3; i++ )
+      {
+        OutgoingMsg.pBuffer[2+i] = (unsigned char)(Counters[i/4] >> (8*(i%4)));
+      }
+
+      OutgoingMsg.Length += 4*3;
+      OutgoingMsg.Options = NV_SUCCESS;
+    }
+    break;
+
   default:
     break;
   }
@@ -1358,18 +2007,18 @@ void SaveAlarm(void)
 {
   for(unsigned char i = 0; i < 10; i++)
   {
-    OsalNvWrite(NVID_ALARM_ON,
-                i,
+    OsalNvWrite(NVID_ALARM_ON + i,
+                NV_ZERO_OFFSET,
                 sizeof(nvAlarmOn[i]),
                 &nvAlarmOn[i]);
     
-    OsalNvWrite(NVID_ALARM_MIN,
-                i,
+    OsalNvWrite(NVID_ALARM_MIN + i,
+                NV_ZERO_OFFSET,
                 sizeof(nvAlarmMinutes[i]),
                 &nvAlarmMinutes[i]);
 
-    OsalNvWrite(NVID_ALARM_HOUR,
-                i,
+    OsalNvWrite(NVID_ALARM_HOUR + i,
+                NV_ZERO_OFFSET,
                 sizeof(nvAlarmHours[i]),
                 &nvAlarmHours[i]);
   }
@@ -1410,6 +2059,7 @@ unsigned char AddAlarmMinute()
     {
       nvAlarmMinutes[currentAlarm]++;
     }
+  RequestAlarmSchedule();
   return nvAlarmMinutes[currentAlarm];  
 }
 
@@ -1423,6 +2073,7 @@ unsigned char AddAlarmHour()
     {
       nvAlarmHours[currentAlarm]++;
     }
+    RequestAlarmSchedule();
     return nvAlarmHours[currentAlarm];
   
 }
@@ -1435,6 +2086,76 @@ unsigned char GetAlarmStatus()
 void SetAlarmStatus(unsigned char on)
 {
   nvAlarmOn[currentAlarm] = on;
+  RequestAlarmSchedule();
+}
+
+void RequestAlarmSchedule(void)
+{
+  tMessage Msg;
+  SetupMessage(&Msg,AlarmControl,NO_MSG_OPTIONS);
+  RouteMsg(&Msg);
+}
+
+/* ring the alarms that are due now and then program the next one */
+static void AlarmControlHandler(void)
+{
+  unsigned char doAlarm = 0; // ?    10 ,     
+  
+  //  
+  for(unsigned char i = 0; i < 10; i++)
+  {
+    if(nvAlarmOn[i] == 0)
+      continue;
+    
+    if(RTCHOUR == nvAlarmHours[i] && RTCMIN == nvAlarmMinutes[i])
+    {
+      //  
+      nvAlarmOn[i] = 0;
+      doAlarm = 1;
+    }
+  }
+  if(doAlarm == 1)
+    GenerateAlarm();
+  
+  ScheduleNextAlarm();
+}
+
+/* find the alarm that comes first after the current minute */
+static void ScheduleNextAlarm(void)
+{
+  unsigned int Now = RTCHOUR*60 + RTCMIN;
+  unsigned int Shortest = MINUTES_PER_DAY + 1;
+  unsigned int Distance;
+  unsigned char Next = 0;
+  
+  for(unsigned char i = 0; i < 10; i++)
+  {
+    if(nvAlarmOn[i] == 0)
+      continue;
+    
+    Distance = nvAlarmHours[i]*60 + nvAlarmMinutes[i] + MINUTES_PER_DAY - Now;
+    
+    /* an alarm in the current minute is due again tomorrow */
+    if ( Distance > MINUTES_PER_DAY )
+    {
+      Distance -= MINUTES_PER_DAY;
+    }
+    
+    if ( Distance < Shortest )
+    {
+      Shortest = Distance;
+      Next = i;
+    }
+  }
+  
+  if ( Shortest <= MINUTES_PER_DAY )
+  {
+    halRtcSetAlarm(nvAlarmHours[Next],nvAlarmMinutes[Next]);
+  }
+  else
+  {
+    halRtcDisableAlarm();
+  }
 }
 
 void GenerateAlarm(void)
@@ -40,6 +40,7 @@ void InitializeBackgroundTask(void);
 void SaveRstNmiConfiguration(void);
 
 //
+void InitializeAlarm(void);
 void SaveAlarm(void);
 unsigned char GetAlarmStatus();
 void SetAlarmStatus(unsigned char on);
@@ -50,6 +51,16 @@ unsigned char AddAlarmHour();
 unsigned char GetCurrentAlarm();
 unsigned char IncCurrentAlarm();
 
+/*! Have the background task check the alarms and program the rtc alarm
+ * with the next one.  Call this when the time or an alarm is changed.
+ */
+void RequestAlarmSchedule(void);
+
+/*! Copy the diary records saved in non-volatile memory to the serial ram.
+ * The serial ram must be initialized first.
+ */
+void InitializeDiary(void);
+
 //  ?
 unsigned char IsUpdateDiary();
 
@@ -50,14 +50,20 @@ typedef struct
 
 
 // This memory is never accessed directly, pointers to the buffers are put on
-// a queue at startup
+// the free list at startup
 static tBufferPoolBuffer BufferPool[NUM_MSG_BUFFERS];
 
-// all pointers on/off the queue must be in this range, use these to check the
-// buffer free to make sure we don't trash the pool
+// all pointers on/off the free list must be in this range, use these to check
+// the buffer free to make sure we don't trash the pool
 static const unsigned char* LOW_BUFFER_ADDRESS   = &(BufferPool[0].buffer[0]);
 static const unsigned char* HIGH_BUFFER_ADDRESS  = &(BufferPool[NUM_MSG_BUFFERS - 1].buffer[0]);
 
+// The free buffers are a stack of pointers.  Taking a pointer off or putting
+// one back is short enough to do with interrupts disabled, so it can also be
+// done from an isr (the free queue was too slow for that).
+static unsigned char* FreeList[NUM_MSG_BUFFERS];
+static unsigned char FreeCount;
+
 static void SetBufferPoolFailureBit(void)
 {
   PrintString("************Buffer Pool Failure************\r\n");
@@ -67,93 +73,113 @@ static void SetBufferPoolFailureBit(void)
 void InitializeBufferPool( void )
 {
   unsigned int  ii;              // loop counter
-  unsigned char* pMsgBuffer;      // holds the address of the msg buffer to add to the queue
-  
-  // create the queue to hold the free message buffers
-  QueueHandles[FREE_QINDEX] =
-    xQueueCreate( ( unsigned portBASE_TYPE ) NUM_MSG_BUFFERS,
-                  ( unsigned portBASE_TYPE ) sizeof(unsigned char*) );
-  
-  // Add the address of each buffer's data section to the queue
+
+  // Add the address of each buffer's data section to the free list
   for(ii = 0; ii < NUM_MSG_BUFFERS; ii++)
   {
       // use the address of the data section so that the header is only accessed
       // as needed
-      pMsgBuffer = & (BufferPool[ii].buffer[0]);
-  
-      // We only call this at initialization so it should never fail
-      // params: queue handle, ptr to item to queue, ticks to wait if full
-      if ( xQueueSend( QueueHandles[FREE_QINDEX], &pMsgBuffer, DONT_WAIT ) != pdTRUE )
-      {
-        PrintString("Unable to build Free Queue\r\n");
-        SetBufferPoolFailureBit();
-      }
+      FreeList[ii] = & (BufferPool[ii].buffer[0]);
   }
+
+  FreeCount = NUM_MSG_BUFFERS;
 }
 
-unsigned char* BPL_AllocMessageBuffer(void)
+// must be called with interrupts disabled
+static unsigned char* RemoveFromFreeList(void)
 {
   unsigned char * pBuffer = NULL;
 
-  // params are: queue handle, ptr to the msg buffer, ticks to wait
-  if( pdTRUE != xQueueReceive( QueueHandles[FREE_QINDEX], &pBuffer, DONT_WAIT ) )
+  if ( FreeCount > 0 )
   {
-    PrintString("Unable to Allocate Buffer\r\n");
-    SetBufferPoolFailureBit();
+    pBuffer = FreeList[--FreeCount];
+
+    if ( NUM_MSG_BUFFERS - FreeCount > gAppStats.MaxBuffersInUse )
+    {
+      gAppStats.MaxBuffersInUse = NUM_MSG_BUFFERS - FreeCount;
+    }
   }
 
-  if (   pBuffer < LOW_BUFFER_ADDRESS 
-      || pBuffer > HIGH_BUFFER_ADDRESS )
-  {
-    PrintString("Free Buffer Corruption\r\n");
-    SetBufferPoolFailureBit();
+  return pBuffer;
 }
 
-  return pBuffer;
+// must be called with interrupts disabled
+static unsigned char AddToFreeList(unsigned char* pBuffer)
+{
+  // the list can't be full unless there is a bug
+  if ( FreeCount >= NUM_MSG_BUFFERS )
+  {
+    return 0;
+  }
 
+  FreeList[FreeCount++] = pBuffer;
+  return 1;
 }
 
-#if 0
-/* This is too slow to use */
-unsigned char* BPL_AllocMessageBufferFromISR(void)
-{  
-  unsigned char * pBuffer = NULL;
-
-  signed portBASE_TYPE HigherPriorityTaskWoken;
-  
-  // params are: queue handle, ptr to the msg buffer, ticks to wait
-  if( pdTRUE != xQueueReceiveFromISR(QueueHandles[FREE_QINDEX], 
-                                     &pBuffer, 
-                                     &HigherPriorityTaskWoken ))
+static void CheckAllocatedBuffer(unsigned char* pBuffer)
+{
+  if ( pBuffer == NULL )
   {
-    PrintString("Unable to Allocate Buffer from Isr\r\n");
+    PrintString("Unable to Allocate Buffer\r\n");
     SetBufferPoolFailureBit();
   }
-  
-  if ( HigherPriorityTaskWoken == pdTRUE )
+
+  if (   pBuffer < LOW_BUFFER_ADDRESS
+      || pBuffer > HIGH_BUFFER_ADDRESS )
   {
-    portYIELD();
+    PrintString("Free Buffer Corruption\r\n");
+    SetBufferPoolFailureBit();
   }
-  
-  return pBuffer;
-  
 }
-#endif
 
-void BPL_FreeMessageBuffer(unsigned char* pBuffer)
+static void CheckFreedBuffer(unsigned char* pBuffer)
 {
   // make sure the returned pointer is in range
-  if (   pBuffer < LOW_BUFFER_ADDRESS 
+  if (   pBuffer < LOW_BUFFER_ADDRESS
       || pBuffer > HIGH_BUFFER_ADDRESS )
   {
     PrintString("Free Buffer Corruption\r\n");
     SetBufferPoolFailureBit();
   }
+}
+
+unsigned char* BPL_AllocMessageBuffer(void)
+{
+  unsigned char * pBuffer;
+
+  portENTER_CRITICAL();
+  pBuffer = RemoveFromFreeList();
+  portEXIT_CRITICAL();
+
+  CheckAllocatedBuffer(pBuffer);
+
+  return pBuffer;
+
+}
+
+/* interrupts are already disabled in an isr */
+unsigned char* BPL_AllocMessageBufferFromIsr(void)
+{
+  unsigned char * pBuffer = RemoveFromFreeList();
+
+  CheckAllocatedBuffer(pBuffer);
+
+  return pBuffer;
+
+}
 
-  // params are: queue handle, ptr to item to queue, tick to wait if full
-  // the queue can't be full unless there is a bug, so don't wait on full
-  if( pdTRUE != xQueueSend(QueueHandles[FREE_QINDEX], &pBuffer, DONT_WAIT) )
+void BPL_FreeMessageBuffer(unsigned char* pBuffer)
 {
+  unsigned char Result;
+
+  CheckFreedBuffer(pBuffer);
+
+  portENTER_CRITICAL();
+  Result = AddToFreeList(pBuffer);
+  portEXIT_CRITICAL();
+
+  if ( Result == 0 )
+  {
     PrintString("Unable to add buffer to Free Queue\r\n");
     SetBufferPoolFailureBit();
   }
@@ -162,33 +188,13 @@ void BPL_FreeMessageBuffer(unsigned char* pBuffer)
 
 void BPL_FreeMessageBufferFromIsr(unsigned char* pBuffer)
 {
-  // make sure the returned pointer is in range
-  if (   pBuffer < LOW_BUFFER_ADDRESS 
-      || pBuffer > HIGH_BUFFER_ADDRESS )
-  {
-    PrintString("Free Buffer Corruption\r\n");
-    SetBufferPoolFailureBit();
-  }
+  CheckFreedBuffer(pBuffer);
 
-  signed portBASE_TYPE HigherPriorityTaskWoken;
-  
-  // params are: queue handle, ptr to item to queue, tick to wait if full
-  // the queue can't be full unless there is a bug, so don't wait on full
-  if( pdTRUE != xQueueSendFromISR(QueueHandles[FREE_QINDEX], 
-                                  &pBuffer, 
-                                  &HigherPriorityTaskWoken) )
+  if ( AddToFreeList(pBuffer) == 0 )
   {
     PrintString("Unable to add buffer to Free Queue\r\n");
     SetBufferPoolFailureBit();
   }
 
-#if 0
-  /* this should never be true when freeing a message buffer */
-  if ( HigherPriorityTaskWoken == pdTRUE )
-  {
-    portYIELD();
-  }
-#endif
-  
 }
 
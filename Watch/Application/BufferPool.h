@@ -18,7 +18,7 @@
 /*! \file BufferPool.h
  *
  * The buffer pool is block of memory used for message allocation.  All of the 
- * free buffers are put into the free queue.
+ * free buffers are put into the free list.
  *
  */
 /******************************************************************************/
@@ -31,7 +31,7 @@
 #endif
 
 
-/*! Initialize memory used by the buffer pool.  The buffer pool is a queue
+/*! Initialize memory used by the buffer pool.  The buffer pool is a list
  * that holds free memory buffers that are used for tHostMsg messages.
  */
 void InitializeBufferPool(void);
@@ -42,6 +42,12 @@ void InitializeBufferPool(void);
  */
 unsigned char* BPL_AllocMessageBuffer(void);
 
+/*! Remove a message from the free buffer pool (from an isr)
+ * 
+ * \return a pointer to a buffer
+ */
+unsigned char* BPL_AllocMessageBufferFromIsr(void);
+
 /*! Add a message to the free buffer pool.  This function performs basic memory
  * range checking.
  * 
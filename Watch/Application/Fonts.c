@@ -28,6 +28,13 @@
 /*! The number of printable characters in the font tables */
 #define PRINTABLE_CHARACTERS ( 128 )
 
+/* 
+ * The tables below are maintained by hand and are not generated.  Rows are 
+ * already in the order the LCD row writer uses (LSB is the leftmost pixel),
+ * so they are drawn straight from flash.  5ru.fnt and framd.ttf are not their
+ * source: 5ru.fnt describes a 32 pixel anti-aliased font whose texture 
+ * (5ru_0.tga) is not in the tree.
+ */
 
 const unsigned char MetaWatch5table[PRINTABLE_CHARACTERS][5];
 const unsigned char MetaWatch7table[PRINTABLE_CHARACTERS][7];
@@ -206,6 +213,41 @@ void GetCharacterBitmap(unsigned char Character,unsigned int * pBitmap)
 
 }
 
+unsigned char const * GetCharacterBitmapPointer(unsigned char Character,
+                                                unsigned char * pBytesPerRow)
+{
+  unsigned char index = MapCharacterToIndex(Character);
+  unsigned char const * pRows = (unsigned char const *)MetaWatch5table[0];
+  
+  *pBytesPerRow = sizeof(unsigned char);
+  
+  switch (CurrentFont.Type)
+  {
+  case MetaWatch5:
+    pRows = MetaWatch5table[index];
+    break;
+  
+  case MetaWatch7:
+    pRows = MetaWatch7table[index];
+    break;
+  
+  case MetaWatch16:
+    pRows = (unsigned char const *)MetaWatch16table[index];
+    *pBytesPerRow = sizeof(unsigned int);
+    break;
+  
+  case MetaWatchTime:
+    pRows = (unsigned char const *)MetaWatchTimeTable[index];
+    *pBytesPerRow = sizeof(unsigned int);
+    break;
+    
+  default:
+    break;
+  }
+  
+  return pRows;
+}
+
 const unsigned char MetaWatch5table[PRINTABLE_CHARACTERS][5] = 
 {
   /* character 0x20 (' '): (width = 2) */
@@ -83,6 +83,20 @@ unsigned char MapDigitToIndex(unsigned char Digit);
  */
 void GetCharacterBitmap(unsigned char Character,unsigned int * pBitmap);
 
+/*! Get a pointer to the bitmap of the specified character in the font table
+ *
+ * \param Character is the desired character
+ * \param pBytesPerRow is set to the size of each row (1 for byte fonts and
+ * 2 for word fonts)
+ * \return pointer to the first row of the bitmap
+ *
+ * \note The tables are stored in LCD row order (the LSB is the leftmost
+ * pixel) so the rows can be written to the display directly from flash
+ * without copying them with GetCharacterBitmap first.
+ */
+unsigned char const * GetCharacterBitmapPointer(unsigned char Character,
+                                                unsigned char * pBytesPerRow);
+
 /*! Get the width for a specified character *
  *
  * \param Character is the desired character
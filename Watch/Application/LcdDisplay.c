@@ -20,6 +20,8 @@
  */
 /******************************************************************************/
 
+#include <string.h>
+
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
@@ -63,6 +65,10 @@ static void DisplayTask(void *pvParameters);
 
 static void DisplayQueueMessageHandler(tMessage* pMsg);
 static void SendMyBufferToLcd(unsigned char TotalRows);
+static void SendMyBufferRowsToLcd(void);
+static void WaitForMyBufferFlush(void);
+static void AddMyBufferRows(unsigned char StartingRow,
+                            unsigned char NumberOfRows);
 
 static tMessage DisplayMsg;
 
@@ -84,6 +90,7 @@ static void MenuModeHandler(unsigned char MsgOptions);
 static void MenuButtonHandler(unsigned char MsgOptions);
 static void ToggleSecondsHandler(unsigned char MsgOptions);
 static void ConnectionStateChangeHandler(void);
+static void SaveSettingsAndResetHandler(unsigned char MsgOptions);
 static void CalendarHandler(tMessage* pMsg);
 
 /******************************************************************************/
@@ -125,13 +132,106 @@ static void WriteIcon4w10h(unsigned char const * pIcon,
                            unsigned char ColumnOffset);
 
 static void DisplayAmPm(unsigned char row);
+static void DrawTimeStripCell(unsigned char Cell, unsigned char Character);
 static void DisplayDayOfWeek(void);
 static void DisplayDate(void);
 static void DisplayDiary(void);
+static void DisplayStatusIcons(void);
+static unsigned char GetIdleStatusIcon(void);
+static unsigned char GetChangedIdleLayers(void);
 
 
 static tLcdLine pMyBuffer[NUM_LCD_ROWS];
 
+/* 
+ * Frames are drawn into pMyBuffer and then copied (and inverted) into
+ * pLcdBuffer.  pLcdBuffer belongs to the LCD driver while a frame is in 
+ * flight so the next frame can be drawn while the DMA is running.
+ */
+static tLcdLine pLcdBuffer[NUM_LCD_ROWS];
+static unsigned char FlushPending;
+static portTickType FrameRequestTick;
+static portTickType FlushRequestTick;
+
+/* 
+ * rows drawn since the last update, rows cleared since the last update
+ * and rows that were drawn on the lcd
+ */
+static unsigned char MyBufferRowMap[LCD_ROW_MAP_BYTES];
+static unsigned char MyBufferClearedMap[LCD_ROW_MAP_BYTES];
+static unsigned char LcdRowMap[LCD_ROW_MAP_BYTES];
+static unsigned char LcdRowMapInvert;
+
+#define IDLE_TIME_ROW    ( 6 )
+#define IDLE_DATE_ROW    ( 30 )
+#define DIARY_ROW        ( 42 )
+#define DIARY_ROW_HEIGHT ( 19 )
+#define MENU_TIME_ROW    ( 38 )
+#define IDLE_DATE_ROWS   ( 7 )
+
+/* 
+ * The time is drawn into a strip that is kept between updates.  Only the 
+ * cells whose character changed are redrawn and then the strip is copied
+ * into pMyBuffer (h h : m m : s s).
+ */
+#define TIME_STRIP_ROWS       ( 19 )
+#define TIME_STRIP_CELLS      ( 8 )
+#define TIME_STRIP_EMPTY_CELL ( 0xff )
+
+static unsigned char TimeStrip[TIME_STRIP_ROWS][NUM_LCD_COL_BYTES];
+
+static unsigned char TimeStripCharacters[TIME_STRIP_CELLS] = 
+{
+  TIME_STRIP_EMPTY_CELL, TIME_STRIP_EMPTY_CELL, 
+  TIME_STRIP_EMPTY_CELL, TIME_STRIP_EMPTY_CELL, 
+  TIME_STRIP_EMPTY_CELL, TIME_STRIP_EMPTY_CELL, 
+  TIME_STRIP_EMPTY_CELL, TIME_STRIP_EMPTY_CELL
+};
+
+/* starting pixel column of each cell (digits are 11 + 1, colons are 4 + 1) */
+static const unsigned char TimeStripCellColumn[TIME_STRIP_CELLS + 1] = 
+{
+  4, 16, 28, 33, 45, 57, 62, 74, 86
+};
+
+/*
+ * The watch part of the idle screen is drawn in layers.  Each layer owns a
+ * band of rows and remembers the state it was drawn from so that an idle 
+ * update only clears, redraws and sends the layers that changed.  The layers
+ * are only valid while pMyBuffer holds the idle screen that is on the lcd.
+ */
+#define IDLE_LAYER_TIME   ( BIT0 )
+#define IDLE_LAYER_STATUS ( BIT1 )
+#define IDLE_LAYER_DATE   ( BIT2 )
+#define IDLE_LAYER_DIARY  ( BIT3 )
+#define IDLE_LAYERS_ALL   ( 0x0f )
+#define TOTAL_IDLE_LAYERS ( 4 )
+
+#define IDLE_STATUS_NONE        ( 0 )
+#define IDLE_STATUS_CHARGING    ( 1 )
+#define IDLE_STATUS_LOW_BATTERY ( 2 )
+
+typedef struct
+{
+  unsigned char StartingRow;
+  unsigned char NumberOfRows;
+  
+} tIdleLayer;
+
+/* in the same order as the layer bits */
+static const tIdleLayer IdleLayers[TOTAL_IDLE_LAYERS] = 
+{
+  { IDLE_TIME_ROW, TIME_STRIP_ROWS },
+  { IDLE_PAGE_ICON2_STARTING_ROW, IDLE_PAGE_ICON2_SIZE_IN_ROWS },
+  { IDLE_DATE_ROW, IDLE_DATE_ROWS },
+  { DIARY_ROW, NUM_LCD_ROWS - DIARY_ROW }
+};
+
+static unsigned char IdleLayersValid;
+static unsigned char IdleTimeState[4];
+static unsigned char IdleDateState[5];
+static unsigned char IdleStatusState;
+
 /******************************************************************************/
 
 static unsigned char nvIdleBufferConfig;
@@ -146,6 +246,17 @@ static void SaveDisplaySeconds(void);
 
 /******************************************************************************/
 
+/* settings that were changed but have not been written to flash yet */
+#define LINK_ALARM_SETTING  ( BIT0 )
+#define RST_NMI_SETTING     ( BIT1 )
+#define INVERT_SETTING      ( BIT2 )
+#define SECONDS_SETTING     ( BIT3 )
+#define ALARM_SETTING       ( BIT4 )
+
+static unsigned char DirtySettings;
+
+/******************************************************************************/
+
 /******************************************************************************/
 
 typedef enum
@@ -271,6 +382,9 @@ static void DisplayTask(void *pvParameters)
   DisplayStartupScreen();
 
   SerialRamInit();
+#ifdef DIARY
+  InitializeDiary();
+#endif
 
   InitializeIdleBufferConfig();
   InitializeIdleBufferInvert();
@@ -295,9 +409,19 @@ static void DisplayTask(void *pvParameters)
 
   for(;;)
   {
+    /* nothing else to draw so finish the frame before sleeping */
+    if ( uxQueueMessagesWaiting(QueueHandles[DISPLAY_QINDEX]) == 0 )
+    {
+      WaitForMyBufferFlush();
+    }
+    
     if( pdTRUE == xQueueReceive(QueueHandles[DISPLAY_QINDEX],
                                 &DisplayMsg, portMAX_DELAY) )
     {
+      CountReceivedMsg(DISPLAY_QINDEX,&DisplayMsg);
+
+      FrameRequestTick = xTaskGetTickCount();
+      
       PrintMessageType(&DisplayMsg);
 
       DisplayQueueMessageHandler(&DisplayMsg);
@@ -338,6 +462,7 @@ static void DisplayQueueMessageHandler(tMessage* pMsg)
     break;
 
   case UpdateDisplay:
+    /* the watch draws its own screens, so the phone's update is ignored */
     //!!!!!!UpdateDisplayHandler(pMsg);
     break;
 
@@ -408,6 +533,11 @@ static void DisplayQueueMessageHandler(tMessage* pMsg)
 
   case LowBatteryWarningMsg:
   case LowBatteryBtOffMsg:
+    SaveMenuSettings();
+    break;
+
+  case SaveSettingsAndResetMsg:
+    SaveSettingsAndResetHandler(pMsg->Options);
     break;
 
   case LinkAlarmMsg:
@@ -460,6 +590,9 @@ static inline void StopDisplayTimer(void)
  */
 static void IdleUpdateHandler(void)
 {
+  /* leaving the menu in any way commits the settings */
+  SaveMenuSettings();
+
   //ContinueRtc();
   calendarEditMode = CalEditNone;
   StopDisplayTimer();
@@ -473,11 +606,11 @@ static void IdleUpdateHandler(void)
      */
     if ( nvIdleBufferConfig == WATCH_CONTROLS_TOP )
     {
-      /* only draw watch part */
-      FillMyBuffer(STARTING_ROW,PHONE_FULL_BUFFER_ROWS,0x00);//WATCH_DRAWN_IDLE_BUFFER_ROWS
+      /* only draw the layers of the watch part that changed */
       DrawIdleScreen();
       PrepareMyBufferForLcd(STARTING_ROW,PHONE_FULL_BUFFER_ROWS);//WATCH_DRAWN_IDLE_BUFFER_ROWS WATCH_DRAWN_IDLE_BUFFER_ROWS
-      SendMyBufferToLcd(PHONE_FULL_BUFFER_ROWS);//WATCH_DRAWN_IDLE_BUFFER_ROWS
+      SendMyBufferRowsToLcd();
+      IdleLayersValid = IDLE_LAYERS_ALL;
     }
 
     /* now update the remainder of the display */
@@ -1213,11 +1346,13 @@ static void ModifyTimeHandler(tMessage* pMsg)
     time = RTCHOUR;
     time++; if ( time == 24 ) time = 0;
     RTCHOUR = time;
+    RequestAlarmSchedule();
     break;
   case MODIFY_TIME_INCREMENT_MINUTE:
     time = RTCMIN;
     time++; if ( time == 60 ) time = 0;
     RTCMIN = time;
+    RequestAlarmSchedule();
     break;
   case MODIFY_TIME_INCREMENT_DOW:
     /* modify the day of the week (not the day of the month) */
@@ -1246,7 +1381,85 @@ unsigned char GetIdleBufferConfiguration(void)
 
 static void SendMyBufferToLcd(unsigned char TotalRows)
 {
-  UpdateMyDisplay((unsigned char*)pMyBuffer,TotalRows);
+  StartMyDisplayUpdate((unsigned char*)pLcdBuffer,TotalRows);
+  FlushPending = 1;
+  FlushRequestTick = FrameRequestTick;
+  
+  /* everything that was sent has to be redrawn on the next partial update */
+  unsigned char row;
+  for ( row = 0; row < LCD_ROW_MAP_BYTES; row++ )
+  {
+    MyBufferRowMap[row] = 0;
+    MyBufferClearedMap[row] = 0;
+    LcdRowMap[row] = 0;
+  }
+  
+  for ( row = STARTING_ROW; row < TotalRows && row < NUM_LCD_ROWS; row++ )
+  {
+    LcdRowMap[row >> 3] |= (1 << (row & 0x07));
+  }
+  
+  LcdRowMapInvert = QueryInvertDisplay();
+}
+
+/* Send the rows that were drawn since the last update along with the rows
+ * that were drawn on the lcd and have been cleared since (they have to be 
+ * erased).
+ */
+static void SendMyBufferRowsToLcd(void)
+{
+  unsigned char SendMap[LCD_ROW_MAP_BYTES];
+  unsigned char i;
+  
+  /* every row changes when the display is inverted */
+  unsigned char AllRows = ( LcdRowMapInvert != QueryInvertDisplay() );
+  
+  for ( i = 0; i < LCD_ROW_MAP_BYTES; i++ )
+  {
+    SendMap[i] = AllRows ? 0xff 
+                         : (MyBufferRowMap[i] | (LcdRowMap[i] & MyBufferClearedMap[i]));
+    LcdRowMap[i] = (LcdRowMap[i] & ~MyBufferClearedMap[i]) | MyBufferRowMap[i];
+    MyBufferRowMap[i] = 0;
+    MyBufferClearedMap[i] = 0;
+  }
+  
+  LcdRowMapInvert = QueryInvertDisplay();
+  
+  StartMyDisplayRowsUpdate((unsigned char*)pLcdBuffer,SendMap);
+  FlushPending = 1;
+  FlushRequestTick = FrameRequestTick;
+}
+
+/* Wait until the lcd buffer is no longer in use by the dma and
+ * keep track of how long it took from the message to the pixels 
+ */
+static void WaitForMyBufferFlush(void)
+{
+  WaitForMyDisplayUpdate();
+  
+  if ( FlushPending )
+  {
+    FlushPending = 0;
+    
+    gAppStats.LcdFrameLatency = xTaskGetTickCount() - FlushRequestTick;
+    
+    if ( gAppStats.LcdFrameLatency > gAppStats.MaxLcdFrameLatency )
+    {
+      gAppStats.MaxLcdFrameLatency = gAppStats.LcdFrameLatency;
+    }
+  }
+}
+
+/* Called by the drawing functions to report the rows they touched */
+static void AddMyBufferRows(unsigned char StartingRow,
+                            unsigned char NumberOfRows)
+{
+  unsigned char row = StartingRow;
+  
+  for ( ; row < NUM_LCD_ROWS && row < StartingRow+NumberOfRows; row++ )
+  {
+    MyBufferRowMap[row >> 3] |= (1 << (row & 0x07));
+  }
 }
 
 
@@ -1264,10 +1477,21 @@ static void InitMyBuffer(void)
       pMyBuffer[row].Row = row+FIRST_LCD_LINE_OFFSET;
       pMyBuffer[row].Data[col] = 0x00;
       pMyBuffer[row].Dummy = 0x00;
+      
+      pLcdBuffer[row].Row = row+FIRST_LCD_LINE_OFFSET;
+      pLcdBuffer[row].Data[col] = 0x00;
+      pLcdBuffer[row].Dummy = 0x00;
 
     }
   }
 
+  /* the contents of the lcd are not known */
+  for(row = 0; row < LCD_ROW_MAP_BYTES; row++)
+  {
+    MyBufferRowMap[row] = 0;
+    MyBufferClearedMap[row] = 0;
+    LcdRowMap[row] = 0xff;
+  }
 
 }
 
@@ -1287,6 +1511,8 @@ static void FillMyBuffer(unsigned char StartingRow,
     {
       pMyBuffer[row].Data[col] = FillValue;
     }
+    
+    MyBufferClearedMap[row >> 3] |= (1 << (row & 0x07));
   }
 
 }
@@ -1297,18 +1523,23 @@ static void PrepareMyBufferForLcd(unsigned char StartingRow,
   int row = StartingRow;
   int col;
 
+  /* the previous frame may still be using the lcd buffer */
+  WaitForMyBufferFlush();
+  
+  /* whatever is being sent may not be the idle screen */
+  IdleLayersValid = 0;
+  
   /*
-   * flip the bits before sending to LCD task because it will
-   * dma this portion of the screen
+   * flip the bits while copying into the buffer that the LCD driver
+   * will dma so that the draw buffer is left alone
   */
-  if ( QueryInvertDisplay() == NORMAL_DISPLAY )
+  unsigned char Invert = ( QueryInvertDisplay() == NORMAL_DISPLAY ) ? 0xff : 0x00;
+  
+  for( ; row < NUM_LCD_ROWS && row < StartingRow+NumberOfRows; row++)
   {
-    for( ; row < NUM_LCD_ROWS && row < StartingRow+NumberOfRows; row++)
+    for(col = 0; col < NUM_LCD_COL_BYTES; col++)
     {
-      for(col = 0; col < NUM_LCD_COL_BYTES; col++)
-      {
-        pMyBuffer[row].Data[col] = ~(pMyBuffer[row].Data[col]);
-      }
+      pLcdBuffer[row].Data[col] = pMyBuffer[row].Data[col] ^ Invert;
     }
   }
 
@@ -1373,15 +1604,13 @@ static void CopyColumnsIntoMyBuffer(unsigned char const* pImage,
 
 static void DrawTimeString(unsigned char row, unsigned char showSeconds)
 {
-  gRow = row;
-  gColumn = 0;
-  gBitColumnMask = BIT4;
+  unsigned char Characters[TIME_STRIP_CELLS];
+  unsigned char Cell;
+  unsigned char Row;
+  unsigned char Column;
 
   SetFont(MetaWatchTime);
 
-  unsigned char msd;
-  unsigned char lsd;
-
   /* display hour */
   int Hour = RTCHOUR;
 
@@ -1398,42 +1627,64 @@ static void DrawTimeString(unsigned char row, unsigned char showSeconds)
     }
   }
 
-  msd = Hour / 10;
-  lsd = Hour % 10;
-  
   /* if first digit is zero then leave location blank */
-  if ( msd == 0 && GetTimeFormat() == TWELVE_HOUR )
+  if ( Hour / 10 == 0 && GetTimeFormat() == TWELVE_HOUR )
   {
-    WriteFontCharacter(TIME_CHARACTER_SPACE_INDEX);
+    Characters[0] = TIME_CHARACTER_SPACE_INDEX;
   }
   else
   {
-    WriteFontCharacter(msd);
+    Characters[0] = Hour / 10;
   }
-
-  WriteFontCharacter(lsd);
-
-  WriteFontCharacter(TIME_CHARACTER_COLON_INDEX);
+  
+  Characters[1] = Hour % 10;
+  Characters[2] = TIME_CHARACTER_COLON_INDEX;
 
   /* display minutes */
   int Minutes = RTCMIN;
-  msd = Minutes / 10;
-  lsd = Minutes % 10;
-  WriteFontCharacter(msd);
-  WriteFontCharacter(lsd);
+  Characters[3] = Minutes / 10;
+  Characters[4] = Minutes % 10;
 
   if ( showSeconds )
   {
     int Seconds = RTCSEC;
-    msd = Seconds / 10;
-    lsd = Seconds % 10;
-
-    WriteFontCharacter(TIME_CHARACTER_COLON_INDEX);
-    WriteFontCharacter(msd);
-    WriteFontCharacter(lsd);
-
+    Characters[5] = TIME_CHARACTER_COLON_INDEX;
+    Characters[6] = Seconds / 10;
+    Characters[7] = Seconds % 10;
+  }
+  else
+  {
+    Characters[5] = TIME_STRIP_EMPTY_CELL;
+    Characters[6] = TIME_STRIP_EMPTY_CELL;
+    Characters[7] = TIME_STRIP_EMPTY_CELL;
+  }
+  
+  /* only redraw the cells that changed since the last time */
+  for ( Cell = 0; Cell < TIME_STRIP_CELLS; Cell++ )
+  {
+    if ( Characters[Cell] != TimeStripCharacters[Cell] )
+    {
+      DrawTimeStripCell(Cell, Characters[Cell]);
+      TimeStripCharacters[Cell] = Characters[Cell];
+    }
   }
-  else /* now things starting getting fun....*/
+  
+  for ( Row = 0; Row < TIME_STRIP_ROWS && row + Row < NUM_LCD_ROWS; Row++ )
+  {
+    for ( Column = 0; Column < NUM_LCD_COL_BYTES; Column++ )
+    {
+      pMyBuffer[row + Row].Data[Column] |= TimeStrip[Row][Column];
+    }
+  }
+  
+  /* leave the position after the last character like WriteFontCharacter */
+  Column = showSeconds ? TimeStripCellColumn[TIME_STRIP_CELLS] 
+                       : TimeStripCellColumn[TIME_STRIP_CELLS - 3];
+  gRow = row;
+  gColumn = Column >> 3;
+  gBitColumnMask = BIT0 << (Column & 0x07);
+
+  if ( showSeconds == 0 ) /* now things starting getting fun....*/
   {
     DisplayAmPm(row);
 
@@ -1461,42 +1712,174 @@ static void DrawTimeString(unsigned char row, unsigned char showSeconds)
                           
 static void DrawIdleScreen(void)
 {
-  DrawTimeString(6, nvDisplaySeconds);
+  unsigned char Changed = GetChangedIdleLayers();
+  unsigned char i;
   
-      if ( QueryBatteryCharging() )
+  /* something else was drawn since the last idle update */
+  if ( IdleLayersValid == 0 )
+  {
+    FillMyBuffer(STARTING_ROW,PHONE_FULL_BUFFER_ROWS,0x00);//WATCH_DRAWN_IDLE_BUFFER_ROWS
+  }
+  else
+  {
+    for ( i = 0; i < TOTAL_IDLE_LAYERS; i++ )
+    {
+      if ( Changed & (1 << i) )
       {
-        CopyColumnsIntoMyBuffer(pBatteryChargingIdlePageIconType2,
-                                IDLE_PAGE_ICON2_STARTING_ROW,
-                                IDLE_PAGE_ICON2_SIZE_IN_ROWS,
-                                IDLE_PAGE_ICON2_STARTING_COL,
-                                IDLE_PAGE_ICON2_SIZE_IN_COLS);
+        FillMyBuffer(IdleLayers[i].StartingRow,IdleLayers[i].NumberOfRows,0x00);
       }
-      else
-      {
-        unsigned int bV = ReadBatterySenseAverage();
+    }
+  }
+  
+  if ( Changed & IDLE_LAYER_TIME )
+  {
+    DrawTimeString(IDLE_TIME_ROW, nvDisplaySeconds);
+    AddMyBufferRows(IDLE_TIME_ROW, GetCharacterHeight());
+  }
+  
+  if ( Changed & IDLE_LAYER_STATUS )
+  {
+    DisplayStatusIcons();
+  }
+  
+  if ( Changed & IDLE_LAYER_DATE )
+  {
+    DisplayDayOfWeek();
+    DisplayDate();
+    AddMyBufferRows(IDLE_DATE_ROW, GetCharacterHeight());
+  }
+      
+#ifdef DIARY
+  if ( Changed & IDLE_LAYER_DIARY )
+  {
+    DisplayDiary();
+  }
+#endif
+}
+
+static unsigned char GetIdleStatusIcon(void)
+{
+  unsigned char Status = IDLE_STATUS_NONE;
+  
+  if ( QueryBatteryCharging() )
+  {
+    Status = IDLE_STATUS_CHARGING;
+  }
+  else if ( ReadBatterySenseAverage() < 3500 )
+  {
+    Status = IDLE_STATUS_LOW_BATTERY;
+  }
+  
+  return Status;
+}
+
+static void DisplayStatusIcons(void)
+{
+  switch ( IdleStatusState )
+  {
+  case IDLE_STATUS_CHARGING:
+    CopyColumnsIntoMyBuffer(pBatteryChargingIdlePageIconType2,
+                            IDLE_PAGE_ICON2_STARTING_ROW,
+                            IDLE_PAGE_ICON2_SIZE_IN_ROWS,
+                            IDLE_PAGE_ICON2_STARTING_COL,
+                            IDLE_PAGE_ICON2_SIZE_IN_COLS);
+    AddMyBufferRows(IDLE_PAGE_ICON2_STARTING_ROW,
+                    IDLE_PAGE_ICON2_SIZE_IN_ROWS);
+    break;
+    
+  case IDLE_STATUS_LOW_BATTERY:
+    CopyColumnsIntoMyBuffer(pLowBatteryIdlePageIconType2,
+                            IDLE_PAGE_ICON2_STARTING_ROW,
+                            IDLE_PAGE_ICON2_SIZE_IN_ROWS,
+                            IDLE_PAGE_ICON2_STARTING_COL,
+                            IDLE_PAGE_ICON2_SIZE_IN_COLS);
+    AddMyBufferRows(IDLE_PAGE_ICON2_STARTING_ROW,
+                    IDLE_PAGE_ICON2_SIZE_IN_ROWS);
+    break;
+    
+  default:
+    break;
+  }
+}
 
-        if ( bV < 3500 )
+/* 
+ * Find the layers that have to be redrawn.  The state that each layer is 
+ * drawn from is saved here.
+ */
+static unsigned char GetChangedIdleLayers(void)
+{
+  unsigned char Changed = IDLE_LAYERS_ALL & ~IdleLayersValid;
+  unsigned char Before;
+  unsigned char Time[sizeof(IdleTimeState)];
+  unsigned char Date[sizeof(IdleDateState)];
+  unsigned char Status = GetIdleStatusIcon();
+  unsigned char i;
+  unsigned char j;
+  
+  Time[0] = GetTimeFormat();
+  Time[1] = RTCHOUR;
+  Time[2] = RTCMIN;
+  Time[3] = nvDisplaySeconds ? RTCSEC : 0xff;
+  
+  Date[0] = GetDateFormat();
+  Date[1] = RTCDOW;
+  Date[2] = RTCDAY;
+  Date[3] = RTCMON;
+  Date[4] = (unsigned char)RTCYEAR;
+  
+  if ( memcmp(Time,IdleTimeState,sizeof(Time)) != 0 )
+  {
+    Changed |= IDLE_LAYER_TIME;
+    memcpy(IdleTimeState,Time,sizeof(Time));
+  }
+  
+  /* the diary shows "today" so it changes with the date */
+  if ( memcmp(Date,IdleDateState,sizeof(Date)) != 0 )
+  {
+    Changed |= IDLE_LAYER_DATE | IDLE_LAYER_DIARY;
+    memcpy(IdleDateState,Date,sizeof(Date));
+  }
+  
+  if ( Status != IdleStatusState )
+  {
+    Changed |= IDLE_LAYER_STATUS;
+    IdleStatusState = Status;
+  }
+  
+#ifdef DIARY
+  if ( IsUpdateDiary() )
+  {
+    Changed |= IDLE_LAYER_DIARY;
+  }
+#endif
+
+  /* layers that share rows are cleared (and drawn) together */
+  do
+  {
+    Before = Changed;
+    
+    for ( i = 0; i < TOTAL_IDLE_LAYERS; i++ )
+    {
+      for ( j = 0; j < TOTAL_IDLE_LAYERS; j++ )
+      {
+        if (   (Changed & (1 << i)) 
+            && IdleLayers[i].StartingRow < 
+                 IdleLayers[j].StartingRow + IdleLayers[j].NumberOfRows
+            && IdleLayers[j].StartingRow < 
+                 IdleLayers[i].StartingRow + IdleLayers[i].NumberOfRows )
         {
-          CopyColumnsIntoMyBuffer(pLowBatteryIdlePageIconType2,
-                                  IDLE_PAGE_ICON2_STARTING_ROW,
-                                  IDLE_PAGE_ICON2_SIZE_IN_ROWS,
-                                  IDLE_PAGE_ICON2_STARTING_COL,
-                                  IDLE_PAGE_ICON2_SIZE_IN_COLS);
+          Changed |= (1 << j);
         }
       }
-      DisplayDayOfWeek();
-      DisplayDate();
-      
-#ifdef DIARY
-      DisplayDiary();
-#endif
+    }
+  } while ( Changed != Before );
+  
+  return Changed;
 }
+
 #ifdef DIARY
 static void DisplayDiary(void)
 {
-  if(!IsUpdateDiary())
-    return;
-  
   SetFont(MetaWatch7);
   
   char string0[20]; char string1[20];
@@ -1508,7 +1891,7 @@ static void DisplayDiary(void)
       continue;
 
 
-    gRow = 42 + i*19;
+    gRow = DIARY_ROW + i*DIARY_ROW_HEIGHT;
     gColumn = 0;
     gBitColumnMask = BIT4;
     WriteFontStringSpec(string0, 20, 0 ,0);  
@@ -1517,6 +1900,8 @@ static void DisplayDiary(void)
     gColumn = 0;
     gBitColumnMask = BIT4;  
     WriteFontStringSpec(string1, 20, 0 ,0);
+    
+    AddMyBufferRows(DIARY_ROW + i*DIARY_ROW_HEIGHT, 8 + GetCharacterHeight());
 
   }  
   
@@ -1598,7 +1983,7 @@ static void MenuModeHandler(unsigned char MsgOptions)
 
   /* only invert the part that was just drawn */
   PrepareMyBufferForLcd(STARTING_ROW,NUM_LCD_ROWS);
-  SendMyBufferToLcd(NUM_LCD_ROWS);
+  SendMyBufferRowsToLcd();
 
   /* MENU MODE DOES NOT TIMEOUT */
 
@@ -1666,6 +2051,8 @@ static void DrawMainOptionsPage(void)
                           LEFT_BUTTON_COLUMN,
                           BUTTON_ICON_SIZE_IN_COLUMNS);
   
+  AddMyBufferRows(BUTTON_ICON_A_F_ROW, 2*BUTTON_ICON_SIZE_IN_ROWS);
+  
   /***************************************************************************/
 /*
   if ( QueryLinkAlarmEnable() )
@@ -1731,6 +2118,7 @@ static void DrawOptionSettingsPage(void)
                           LEFT_BUTTON_COLUMN,
                           BUTTON_ICON_SIZE_IN_COLUMNS);
 
+  AddMyBufferRows(BUTTON_ICON_A_F_ROW, 2*BUTTON_ICON_SIZE_IN_ROWS);
 }
 
 /*static void DrawMenu3(void)
@@ -1776,7 +2164,7 @@ static void DrawOptionSettingsPage(void)
 static void DrawAlarmSettingsPage(void)
 {
   SetFont(MetaWatchTime);
-  gRow = 38; //
+  gRow = MENU_TIME_ROW; //
   gColumn = 0; //
   gBitColumnMask = BIT4; //
 
@@ -1843,6 +2231,10 @@ static void DrawAlarmSettingsPage(void)
   unsigned char curAlarmNum = GetCurrentAlarm();
   WriteFontCharacter(curAlarmNum);
   
+  /* the alarm number is inside the button icon rows */
+  AddMyBufferRows(BUTTON_ICON_A_F_ROW, BUTTON_ICON_SIZE_IN_ROWS);
+  AddMyBufferRows(MENU_TIME_ROW, GetCharacterHeight());
+  
   
   /*
   pIcon = pPlusIcon;
@@ -1899,8 +2291,10 @@ static void DrawTimeSettingsPage(void)
   WriteFontCharacter(msd);
   WriteFontCharacter(lsd);
   
-  DrawTimeString(38, 0);
+  DrawTimeString(MENU_TIME_ROW, 0);
 
+  AddMyBufferRows(BUTTON_ICON_A_F_ROW, BUTTON_ICON_SIZE_IN_ROWS);
+  AddMyBufferRows(MENU_TIME_ROW, GetCharacterHeight());
 }
 
 static void DrawCommonMenuIcons(void)
@@ -1922,6 +2316,8 @@ static void DrawCommonMenuIcons(void)
                           BUTTON_ICON_SIZE_IN_ROWS,
                           RIGHT_BUTTON_COLUMN,
                           BUTTON_ICON_SIZE_IN_COLUMNS);
+  
+  AddMyBufferRows(BUTTON_ICON_C_D_ROW, BUTTON_ICON_SIZE_IN_ROWS);
 }
 
 static void MenuButtonHandler(unsigned char MsgOptions)
@@ -1954,6 +2350,7 @@ static void MenuButtonHandler(unsigned char MsgOptions)
 
   case MENU_BUTTON_OPTION_TOGGLE_LINK_ALARM:
     ToggleLinkAlarmEnable();
+    DirtySettings |= LINK_ALARM_SETTING;
     MenuModeHandler(MENU_MODE_OPTION_UPDATE_CURRENT_PAGE);
     break;
 
@@ -1963,11 +2360,7 @@ static void MenuButtonHandler(unsigned char MsgOptions)
     SetupMessage(&OutgoingMsg,PairingControlMsg,PAIRING_CONTROL_OPTION_SAVE_SPP);
     RouteMsg(&OutgoingMsg);
 
-    SaveLinkAlarmEnable();
-    SaveRstNmiConfiguration();
-    SaveIdleBufferInvert();
-    SaveDisplaySeconds();
-    SaveAlarm();
+    SaveMenuSettings();
 
     /* go back to the normal idle screen */
     SetupMessage(&OutgoingMsg,IdleUpdate,NO_MSG_OPTIONS);
@@ -2011,6 +2404,7 @@ static void MenuButtonHandler(unsigned char MsgOptions)
     {
       EnableRstPin();
     }
+    DirtySettings |= RST_NMI_SETTING;
     MenuModeHandler(MENU_MODE_OPTION_UPDATE_CURRENT_PAGE);
     break;
 
@@ -2028,6 +2422,7 @@ static void MenuButtonHandler(unsigned char MsgOptions)
     {
       nvIdleBufferInvert = 1;
     }
+    DirtySettings |= INVERT_SETTING;
     MenuModeHandler(MENU_MODE_OPTION_UPDATE_CURRENT_PAGE);
     break;
 
@@ -2041,16 +2436,19 @@ static void MenuButtonHandler(unsigned char MsgOptions)
     {
       SetAlarmStatus(0);
     }
+    DirtySettings |= ALARM_SETTING;
     MenuModeHandler(MENU_MODE_OPTION_UPDATE_CURRENT_PAGE);
     break;
     
   case MENU_BUTTON_OPTION_ALAM_MIN_PLUS:
     AddAlarmMinute();
+    DirtySettings |= ALARM_SETTING;
     MenuModeHandler(MENU_MODE_OPTION_UPDATE_CURRENT_PAGE);
     break;
     
   case MENU_BUTTON_OPTION_ALAM_HOUR_PLUS:
     AddAlarmHour();
+    DirtySettings |= ALARM_SETTING;
     MenuModeHandler(MENU_MODE_OPTION_UPDATE_CURRENT_PAGE);
     break;
     
@@ -2078,6 +2476,8 @@ static void ToggleSecondsHandler(unsigned char Options)
     nvDisplaySeconds = 0;
   }
 
+  DirtySettings |= SECONDS_SETTING;
+
   if ( Options == TOGGLE_SECONDS_OPTIONS_UPDATE_IDLE )
   {
     IdleUpdateHandler();
@@ -2111,7 +2511,7 @@ static void DisplayAmPm(unsigned char row)
 static void DisplayDayOfWeek(void)
 {
   /* row offset = 0 or 10 , column offset = 8 */
-  gRow = 30;
+  gRow = IDLE_DATE_ROW;
   gColumn = 2;
   gBitColumnMask = BIT0;
   SetFont(MetaWatch7);
@@ -2139,7 +2539,7 @@ static void DisplayDate(void)
     }
 
     /* make it line up with AM/PM and Day of Week */
-    gRow = 30;
+    gRow = IDLE_DATE_ROW;
     gColumn = 5;
     gBitColumnMask = BIT1;
     SetFont(MetaWatch7);
@@ -2998,6 +3398,52 @@ static void SaveDisplaySeconds(void)
               &nvDisplaySeconds);
 }
 
+void SaveMenuSettings(void)
+{
+  unsigned char Dirty = DirtySettings;
+  DirtySettings = 0;
+
+  if ( Dirty & LINK_ALARM_SETTING )
+  {
+    SaveLinkAlarmEnable();
+  }
+
+  if ( Dirty & RST_NMI_SETTING )
+  {
+    SaveRstNmiConfiguration();
+  }
+
+  if ( Dirty & INVERT_SETTING )
+  {
+    SaveIdleBufferInvert();
+  }
+
+  if ( Dirty & SECONDS_SETTING )
+  {
+    SaveDisplaySeconds();
+  }
+
+  if ( Dirty & ALARM_SETTING )
+  {
+    SaveAlarm();
+  }
+}
+
+/* The menu settings belong to this task, so a software reset comes through
+ * here to commit them before the processor is reset.
+ */
+static void SaveSettingsAndResetHandler(unsigned char MsgOptions)
+{
+  SaveMenuSettings();
+
+  if ( MsgOptions == MASTER_RESET_OPTION )
+  {
+    WriteMasterResetKey();
+  }
+
+  SoftwareReset();
+}
+
 unsigned char QueryDisplaySeconds(void)
 {
   return nvDisplaySeconds;
@@ -3010,10 +3456,21 @@ unsigned char QueryInvertDisplay(void)
 
 /******************************************************************************/
 
-static unsigned int CharacterMask;
 static unsigned char CharacterRows;
 static unsigned char CharacterWidth;
-static unsigned int bitmap[MAX_FONT_ROWS];
+static unsigned char const * pCharacterBitmap;
+static unsigned char CharacterBytesPerRow;
+
+static unsigned char GetBitColumnIndex(void);
+static unsigned int ReadCharacterRow(unsigned char Row);
+static void BlitCharacterRows(unsigned char Column, 
+                              unsigned char Width,
+                              unsigned char Invert,
+                              unsigned char Xor);
+static void WriteRowBits(unsigned char Row,
+                         unsigned char Column,
+                         unsigned long Bits,
+                         unsigned char Xor);
 
 /* fonts can be up to 16 bits wide */
 static void WriteFontCharacter(unsigned char Character)
@@ -3023,10 +3480,9 @@ static void WriteFontCharacter(unsigned char Character)
 
 static void WriteFontCharacterSpec(unsigned char Character, unsigned char underline, unsigned char inserse)
 {
-  CharacterMask = BIT0;
   CharacterRows = GetCharacterHeight();
   CharacterWidth = GetCharacterWidth(Character);
-  GetCharacterBitmap(Character,(unsigned int*)&bitmap);
+  pCharacterBitmap = GetCharacterBitmapPointer(Character,&CharacterBytesPerRow);
 
   if ( gRow + CharacterRows > NUM_LCD_ROWS )
   {
@@ -3034,61 +3490,170 @@ static void WriteFontCharacterSpec(unsigned char Character, unsigned char underl
     return;
   }
 
-  /* do things bit by bit */
-  unsigned char i;
+  /* pixel column (the shift direction seems backwards...) */
+  unsigned char Column = gColumn*8 + GetBitColumnIndex();
+  unsigned char Width = 0;
   unsigned char row;
+  
+  /* characters are cut off at the right edge of the screen */
+  if ( Column < NUM_LCD_COL )
+  {
+    Width = CharacterWidth;
+    if ( Width > NUM_LCD_COL - Column )
+    {
+      Width = NUM_LCD_COL - Column;  
+    }
+  }
+  
+  if ( Width )
+  {
+    BlitCharacterRows(Column, Width, inserse == 1, 0);
+  
+    if ( underline && gRow + CharacterRows + 2 < NUM_LCD_ROWS )
+    {
+      WriteRowBits(gRow + CharacterRows + 2,
+                   Column >> 3,
+                   (((unsigned long)1 << Width) - 1) << (Column & 0x07),
+                   0);
+    }
+  }
 
-  for (i = 0 ; i < CharacterWidth && gColumn < NUM_LCD_COL_BYTES; i++ )
-  {        
+  Column += Width;
+  
+  /* inverse characters get one more column on the right */
+  if ( inserse == 1 && Column < NUM_LCD_COL )
+  {
     for(row = 0; row < CharacterRows; row++)
     {
-      if ( (CharacterMask & bitmap[row]) != 0)
-      {
-        if(inserse == 0)
-          pMyBuffer[gRow+row].Data[gColumn] |= gBitColumnMask;
-      }
-      else if(inserse == 1)
-        pMyBuffer[gRow+row].Data[gColumn] |= gBitColumnMask;
-      
+      WriteRowBits(gRow + row, Column >> 3, 1 << (Column & 0x07), 0);
     }
+  }
+  
+  /* add spacing between characters */
+  Column += GetFontSpacing();
+  
+  gColumn = Column >> 3;
+  gBitColumnMask = BIT0 << (Column & 0x07);
+}
+
+/* position of the bit set in gBitColumnMask */
+static unsigned char GetBitColumnIndex(void)
+{
+  unsigned char Index = 0;
+  unsigned char Mask = gBitColumnMask;
+  
+  while ( Mask > BIT0 )
+  {
+    Mask = Mask >> 1;
+    Index++;
+  }
+  
+  return Index;
+}
+
+/* 
+ * Draw the character a whole row at a time straight from the font table.  Each row is shifted 
+ * to the bit offset of the starting column and then written into the 
+ * (up to three) bytes that it covers.  Width must not go past the right edge.
+ */
+static void BlitCharacterRows(unsigned char Column, 
+                              unsigned char Width,
+                              unsigned char Invert,
+                              unsigned char Xor)
+{
+  unsigned int WidthMask = ( Width >= 16 ) ? 0xffff : ((1 << Width) - 1);
+  unsigned char Shift = Column & 0x07;
+  unsigned char row;
+  unsigned int Bits;
+  
+  Column = Column >> 3;
+  
+  for(row = 0; row < CharacterRows; row++)
+  {
+    Bits = ReadCharacterRow(row);
     
-    if(underline)
+    if ( Invert )
     {
-      pMyBuffer[gRow + CharacterRows + 2].Data[gColumn] |= gBitColumnMask;
+      Bits = ~Bits;
     }
     
-    
-
-    /* the shift direction seems backwards... */
-    // 
-    CharacterMask = CharacterMask << 1;
-    gBitColumnMask = gBitColumnMask << 1;
-    if ( gBitColumnMask == 0 )
-    {
-      gBitColumnMask = BIT0;
-      gColumn++;
-    }
+    WriteRowBits(gRow + row, 
+                 Column, 
+                 (unsigned long)(Bits & WidthMask) << Shift, 
+                 Xor);
+  }
+}
 
+static unsigned int ReadCharacterRow(unsigned char Row)
+{
+  if ( CharacterBytesPerRow == sizeof(unsigned int) )
+  {
+    return ((unsigned int const *)pCharacterBitmap)[Row];
+  }
+  else
+  {
+    return pCharacterBitmap[Row];
   }
+}
 
-  if(inserse == 1)
+/* 
+ * Clear one cell of the time strip and draw Character into it.  
+ * The time font must be selected.
+ */
+static void DrawTimeStripCell(unsigned char Cell, unsigned char Character)
+{
+  unsigned char Column = TimeStripCellColumn[Cell];
+  unsigned char Shift = Column & 0x07;
+  unsigned long CellMask = 
+    (((unsigned long)1 << (TimeStripCellColumn[Cell + 1] - Column)) - 1) << Shift;
+  unsigned int WidthMask = 0;
+  unsigned long Bits = 0;
+  unsigned char row;
+  unsigned char i;
+  
+  if ( Character != TIME_STRIP_EMPTY_CELL )
   {
-    for(row = 0; row < CharacterRows; row++)
+    pCharacterBitmap = GetCharacterBitmapPointer(Character,&CharacterBytesPerRow);
+    CharacterWidth = GetCharacterWidth(Character);
+    WidthMask = ( CharacterWidth >= 16 ) ? 0xffff : ((1 << CharacterWidth) - 1);
+  }
+  
+  Column = Column >> 3;
+  
+  for(row = 0; row < TIME_STRIP_ROWS; row++)
+  {
+    if ( WidthMask )
+    {
+      Bits = (unsigned long)(ReadCharacterRow(row) & WidthMask) << Shift;
+    }
+    
+    for ( i = 0; i < 3 && Column + i < NUM_LCD_COL_BYTES; i++ )
     {
-        pMyBuffer[gRow+row].Data[gColumn] |= gBitColumnMask;
+      TimeStrip[row][Column + i] &= ~(unsigned char)(CellMask >> (8 * i));
+      TimeStrip[row][Column + i] |= (unsigned char)(Bits >> (8 * i));
     }
   }
+}
+
+static void WriteRowBits(unsigned char Row,
+                         unsigned char Column,
+                         unsigned long Bits,
+                         unsigned char Xor)
+{
+  unsigned char* pData = pMyBuffer[Row].Data;
   
-  /* add spacing between characters */
-  unsigned char FontSpacing = GetFontSpacing();
-  for(i = 0; i < FontSpacing; i++)
+  for ( ; Bits != 0 && Column < NUM_LCD_COL_BYTES; Column++ )
   {
-    gBitColumnMask = gBitColumnMask << 1;
-    if ( gBitColumnMask == 0 )
+    if ( Xor )
     {
-      gBitColumnMask = BIT0;
-      gColumn++;
+      pData[Column] ^= (unsigned char)Bits;
     }
+    else
+    {
+      pData[Column] |= (unsigned char)Bits;
+    }
+    
+    Bits = Bits >> 8;
   }
 }
 
@@ -3123,10 +3688,9 @@ static void FillRect(unsigned char left, unsigned char top, unsigned char width,
 static void MyWriteFontCharacter(unsigned char Character, unsigned char colunInPixels, 
                                  unsigned char rectangleWidth, unsigned char inserse)
 {
-  CharacterMask = BIT0;
   CharacterRows = GetCharacterHeight();
   CharacterWidth = GetCharacterWidth(Character);
-  GetCharacterBitmap(Character,(unsigned int*)&bitmap);
+  pCharacterBitmap = GetCharacterBitmapPointer(Character,&CharacterBytesPerRow);
 
   if ( gRow + CharacterRows > NUM_LCD_ROWS )
   {
@@ -3134,11 +3698,6 @@ static void MyWriteFontCharacter(unsigned char Character, unsigned char colunInP
     return;
   }
 
-  /* do things bit by bit */
-  unsigned char i;
-  unsigned char row;
-
-  
   signed char offsetPix = 0;
   if(rectangleWidth > 0)
     offsetPix = rectangleWidth / 2 -  CharacterWidth / 2;
@@ -3147,77 +3706,21 @@ static void MyWriteFontCharacter(unsigned char Character, unsigned char colunInP
   
   colunInPixels += offsetPix;
   
-  unsigned char currentByte = colunInPixels / 8;
-  unsigned char currentBit = BIT0 << (colunInPixels % 8);
-  
-    // 
-/*  unsigned char currentBgByte = currentByte;
-  unsigned char currentBgBit = currentBit;
-  if(inserse == 1)
+  if ( colunInPixels >= NUM_LCD_COL )
   {
-    for (i = 0 ; i < CharacterWidth && currentBgByte < NUM_LCD_COL_BYTES; i++ )
-    {
-      for(unsigned char bgRow = 0; bgRow < CharacterRows; bgRow++)
-      {
-          pMyBuffer[gRow+bgRow].Data[currentBgByte] |= currentBgBit;
-      }
-  
-      currentBgBit = currentBgBit << 1;
-      if ( currentBgBit == 0 )
-      {
-        currentBgBit = BIT0;
-        currentBgByte++;
-      }
-  
-    }
-
-  }*/
-  
+    return;  
+  }
   
-  for (i = 0 ; i < CharacterWidth && currentByte < NUM_LCD_COL_BYTES; i++ )
+  unsigned char Width = CharacterWidth;
+  if ( Width > NUM_LCD_COL - colunInPixels )
   {
-    for(row = 0; row < CharacterRows; row++)
-    {
-      //   
-      //   =1,     
-      if ( (CharacterMask & bitmap[row]) != 0 )
-      {
-        if(inserse == 1)
-        {
-          pMyBuffer[gRow+row].Data[currentByte] ^= currentBit;
-        }
-        else
-        {
-          pMyBuffer[gRow+row].Data[currentByte] |= currentBit;
-        }
-      }
-    }
-
-    /* the shift direction seems backwards... */
-    // 
-    CharacterMask = CharacterMask << 1;
-    currentBit = currentBit << 1;
-    if ( currentBit == 0 )
-    {
-      currentBit = BIT0;
-      currentByte++;
-    }
-
+    Width = NUM_LCD_COL - colunInPixels;  
   }
-
-  /* add spacing between characters */
-  /*unsigned char FontSpacing = GetFontSpacing();
-  for(i = 0; i < FontSpacing; i++)
-  {
-    gBitColumnMask = gBitColumnMask << 1;
-    if ( gBitColumnMask == 0 )
-    {
-      gBitColumnMask = BIT0;
-      gColumn++;
-    }
-  }*/
-
+  
+  //     XOR  
+  BlitCharacterRows(colunInPixels, Width, 0, inserse == 1);
 }
+
 void WriteFontString(const tString *pString)
 {
   WriteFontStringSpec(pString, 0, 0, 0);
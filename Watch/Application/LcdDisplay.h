@@ -34,6 +34,9 @@
 #define NUM_LCD_ROWS  96
 #define NUM_LCD_COL   96
 
+/* one bit for each row of the display */
+#define LCD_ROW_MAP_BYTES ( NUM_LCD_ROWS/8 )
+
 /* the internal buffer */
 #define STARTING_ROW                  ( 0 )
 #define WATCH_DRAWN_IDLE_BUFFER_ROWS  ( 40 ) //30
@@ -87,6 +90,13 @@ void InitializeIdleBufferInvert(void);
 /*! Initialize flash/ram value for whether or not to display seconds */
 void InitializeDisplaySeconds(void);
 
+/*! Write the settings that were changed in the menu to flash
+ *
+ * The settings are kept in ram while the menu is open and are written as
+ * one group when the menu is left, before a reset or when the battery is low.
+ */
+void SaveMenuSettings(void);
+
 /*! Called from RTC one second interrupt
  *
  * \return 1 if lpm should be exited, 0 otherwise
@@ -21,6 +21,9 @@
  */
 /******************************************************************************/
 #include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
 
 #include "hal_board_type.h"
 #include "hal_clock_control.h"
@@ -45,9 +48,35 @@ static unsigned char LCD_STATIC_COMMAND[] = {LCD_STATIC_CMD, 0x00, 0x00};
 /* errata - DMA variables cannot be function scope */
 static unsigned char LcdDmaBusy = 0;
 
+/* given by the dma isr when a transfer completes */
+static xSemaphoreHandle LcdDmaSemaphore;
+
+/* 
+ * Waking up a task from an isr takes up to one RTOS tick (~1 ms).
+ * Shorter transfers (single lines and commands) are faster to spin on.
+ */
+#define LCD_DMA_BLOCKING_SIZE ( 128 )
+
+/* size of the update started by StartMyDisplayUpdate (0 when idle) */
+static unsigned int MyDisplayUpdateSize = 0;
+
+/* runs of rows that are still to be sent (chained by the dma isr) */
+static unsigned char RowRunMap[LCD_ROW_MAP_BYTES];
+static unsigned char* pRowRunBuffer;
+static unsigned char NextRunRow = NUM_LCD_ROWS;
+
 /******************************************************************************/
 
 static void WriteLineToLcd(unsigned char* pData,unsigned char Size);
+static void WriteBlockToLcd(unsigned char* pData,unsigned int Size);
+static void FinishMyDisplayUpdate(void);
+static unsigned char GetNextRowRun(unsigned char* pFirstRow,
+                                   unsigned char* pTotalRows);
+
+#ifdef DMA
+static void StartLcdDma(unsigned char* pData,unsigned int Size);
+static void WaitForLcdDmaEnd(unsigned int Size);
+#endif
 
 
 /******************************************************************************/
@@ -82,6 +111,10 @@ void LcdPeripheralInit(void)
   /* remove reset */
   LCD_SPI_UCBxCTL1 &= ~UCSWRST;
   
+  /* the semaphore is created in the given state */
+  vSemaphoreCreateBinary(LcdDmaSemaphore);
+  xSemaphoreTake(LcdDmaSemaphore,0);
+  
 
 }
 
@@ -129,45 +162,13 @@ void PutLcdIntoStaticMode(void)
     
 static void WriteLineToLcd(unsigned char* pData,unsigned char Size)
 {  
+  /* the spi belongs to the frame that is in flight */
+  WaitForMyDisplayUpdate();
+  
   EnableSmClkUser(LCD_USER);
   LCD_CS_ASSERT();
   
-#ifdef DMA
-  
-  LcdDmaBusy = 1;
-  
-  /* USCIB0 TXIFG is the DMA trigger
-   * DMACTL1 controls dma2 and [dma3]
-   */
-  DMACTL1 = DMA2TSEL_19;    
-    
-  __data16_write_addr((unsigned short) &DMA2SA,(unsigned long) pData);
-                                            
-  __data16_write_addr((unsigned short) &DMA2DA,
-                      (unsigned long) &LCD_SPI_UCBxTXBUF);
-            
-  DMA2SZ = (unsigned int)Size;
-  
-  /* 
-   * single transfer, increment source address, source byte and dest byte,
-   * level sensitive, enable interrupt, clear interrupt flag
-   */
-  DMA2CTL = DMADT_0 + DMASRCINCR_3 + DMASBDB + DMALEVEL + DMAIE;  
-  
-  /* start the transfer */
-  DMA2CTL |= DMAEN;
-  
-  while(LcdDmaBusy);
-    
-#else
-
-  for ( unsigned char Index = 0; Index < Size; Index++ )
-  {
-    LCD_SPI_UCBxTXBUF = pData[Index];
-    while (!(LCD_SPI_UCBxIFG&UCTXIFG));
-  }
-
-#endif
+  WriteBlockToLcd(pData,Size);
     
   /* wait for shift to complete ( ~3 us ) */
   while( (LCD_SPI_UCBxSTAT & 0x01) != 0 );
@@ -180,29 +181,179 @@ static void WriteLineToLcd(unsigned char* pData,unsigned char Size)
 
 void UpdateMyDisplay(unsigned char * pBuffer,unsigned int TotalLines)
 {  
+  StartMyDisplayUpdate(pBuffer,TotalLines);
+  WaitForMyDisplayUpdate();
+}
+
+void StartMyDisplayUpdate(unsigned char * pBuffer,unsigned int TotalLines)
+{
+  WaitForMyDisplayUpdate();
+  
   EnableSmClkUser(LCD_USER);
   LCD_CS_ASSERT();
   
+  /* send the lcd write command before starting the dma */
+  LCD_SPI_UCBxTXBUF = LCD_WRITE_CMD;
+  while (!(LCD_SPI_UCBxIFG&UCTXIFG));
+  
+  MyDisplayUpdateSize = TotalLines*sizeof(tLcdLine);
+  
+#ifdef DMA
+  StartLcdDma(pBuffer,MyDisplayUpdateSize);
+#else
+  WriteBlockToLcd(pBuffer,MyDisplayUpdateSize);
+#endif
+}
+
+void WaitForMyDisplayUpdate(void)
+{
+  if ( MyDisplayUpdateSize )
+  {
 #ifdef DMA
+    WaitForLcdDmaEnd(MyDisplayUpdateSize);
+#endif
+    
+    MyDisplayUpdateSize = 0;
+    FinishMyDisplayUpdate();
+  }
+}
+
+unsigned char QueryLcdDmaBusy(void)
+{
+  return LcdDmaBusy;
+}
+
+void UpdateMyDisplayRows(unsigned char * pBuffer,unsigned char const * pRowMap)
+{
+  StartMyDisplayRowsUpdate(pBuffer,pRowMap);
+  WaitForMyDisplayUpdate();
+}
+
+void StartMyDisplayRowsUpdate(unsigned char * pBuffer,
+                              unsigned char const * pRowMap)
+{
+  unsigned char Row;
+  unsigned char FirstRow;
+  unsigned char TotalRows;
+  unsigned int Size = 0;
   
-  LcdDmaBusy = 1;
+  WaitForMyDisplayUpdate();
+  
+  for ( Row = 0; Row < LCD_ROW_MAP_BYTES; Row++ )
+  {
+    RowRunMap[Row] = pRowMap[Row];
+  }
+  
+  for ( Row = 0; Row < NUM_LCD_ROWS; Row++ )
+  {
+    if ( RowRunMap[Row >> 3] & (1 << (Row & 0x07)) )
+    {
+      Size += sizeof(tLcdLine);
+    }
+  }
+  
+  /* nothing changed */
+  if ( Size == 0 )
+  {
+    return;  
+  }
+  
+  pRowRunBuffer = pBuffer;
+  NextRunRow = 0;
+  
+  /* 
+   * every line carries its own row address so runs do not have to 
+   * be adjacent to be sent with one write command
+   */
+  EnableSmClkUser(LCD_USER);
+  LCD_CS_ASSERT();
   
-  /* send the lcd write command before starting the dma */
   LCD_SPI_UCBxTXBUF = LCD_WRITE_CMD;
   while (!(LCD_SPI_UCBxIFG&UCTXIFG));
   
+  MyDisplayUpdateSize = Size;
+  
+  GetNextRowRun(&FirstRow,&TotalRows);
+  
+#ifdef DMA
+  StartLcdDma(pBuffer + FirstRow*sizeof(tLcdLine),TotalRows*sizeof(tLcdLine));
+#else
+  do
+  {
+    WriteBlockToLcd(pBuffer + FirstRow*sizeof(tLcdLine),
+                    TotalRows*sizeof(tLcdLine));
+  } while ( GetNextRowRun(&FirstRow,&TotalRows) );
+#endif
+}
+
+/* find the next group of adjacent rows in the row run map */
+static unsigned char GetNextRowRun(unsigned char* pFirstRow,
+                                   unsigned char* pTotalRows)
+{
+  unsigned char Row = NextRunRow;
+  
+  while (   Row < NUM_LCD_ROWS 
+         && (RowRunMap[Row >> 3] & (1 << (Row & 0x07))) == 0 )
+  {
+    Row++;
+  }
+  
+  if ( Row >= NUM_LCD_ROWS )
+  {
+    NextRunRow = NUM_LCD_ROWS;
+    return 0;
+  }
+  
+  *pFirstRow = Row;
+  
+  while (   Row < NUM_LCD_ROWS 
+         && (RowRunMap[Row >> 3] & (1 << (Row & 0x07))) != 0 )
+  {
+    Row++;
+  }
+  
+  *pTotalRows = Row - *pFirstRow;
+  NextRunRow = Row;
+  
+  return 1;
+}
+
+/* send lines that are already formatted with row address and trailer */
+static void WriteBlockToLcd(unsigned char* pData,unsigned int Size)
+{
+#ifdef DMA
+  
+  StartLcdDma(pData,Size);
+  WaitForLcdDmaEnd(Size);
+
+#else
+
+  for ( unsigned int Index = 0; Index < Size; Index++ )
+  {
+      LCD_SPI_UCBxTXBUF = pData[Index];
+      while (!(LCD_SPI_UCBxIFG&UCTXIFG));
+  }
+    
+#endif
+}
+
+#ifdef DMA
+static void StartLcdDma(unsigned char* pData,unsigned int Size)
+{
+  LcdDmaBusy = 1;
+  
   /* USCIB0 TXIFG is the DMA trigger
    * DMACTL1 controls dma2 and [dma3]
    */
   DMACTL1 = DMA2TSEL_19;    
     
   __data16_write_addr((unsigned short) &DMA2SA,
-                      (unsigned long) pBuffer);
+                      (unsigned long) pData);
                                             
   __data16_write_addr((unsigned short) &DMA2DA,
                       (unsigned long) &LCD_SPI_UCBxTXBUF);
             
-  DMA2SZ = TotalLines*sizeof(tLcdLine);
+  DMA2SZ = Size;
   
   /* 
    * single transfer, increment source address, source byte and dest byte,
@@ -212,24 +363,38 @@ void UpdateMyDisplay(unsigned char * pBuffer,unsigned int TotalLines)
   
   /* start the transfer */
   DMA2CTL |= DMAEN;
-  
-  while(LcdDmaBusy);
-
-#else
+}
 
-  /* send the lcd write command */
-  LCD_SPI_UCBxTXBUF = LCD_WRITE_CMD;
-  while (!(LCD_SPI_UCBxIFG&UCTXIFG));
-  
-  unsigned int Size = TotalLines*sizeof(tLcdLine);
-  for ( unsigned int Index = 0; Index < Size; Index++ )
+/* 
+ * Block the calling task until the dma isr gives the semaphore so that
+ * other tasks can run during long transfers.  The SPI needs SMCLK so 
+ * LPM3 is not allowed while waiting.
+ */
+static void WaitForLcdDmaEnd(unsigned int Size)
+{
+  if ( Size < LCD_DMA_BLOCKING_SIZE )
   {
-      LCD_SPI_UCBxTXBUF = pBuffer[Index];
-      while (!(LCD_SPI_UCBxIFG&UCTXIFG));
+    while(LcdDmaBusy);
   }
+  else
+  {
+    TaskDelayLpmDisable();
     
-#endif
+    while ( LcdDmaBusy )
+    {
+      xSemaphoreTake(LcdDmaSemaphore,portMAX_DELAY);
+    }
+    
+    TaskDelayLpmEnable();
+  }
   
+  /* a short transfer leaves the semaphore given */
+  xSemaphoreTake(LcdDmaSemaphore,0);
+}
+#endif
+
+static void FinishMyDisplayUpdate(void)
+{
   /* add one more dummy byte at the end */
   LCD_SPI_UCBxTXBUF = 0x00;
   while (!(LCD_SPI_UCBxIFG&UCTXIFG));
@@ -246,5 +411,24 @@ void UpdateMyDisplay(unsigned char * pBuffer,unsigned int TotalLines)
 
 void LcdDmaIsr(void)
 {
+  signed portBASE_TYPE HigherPriorityTaskWoken;
+  
+#ifdef DMA
+  unsigned char FirstRow;
+  unsigned char TotalRows;
+  
+  /* start the next run of rows without waking up the task */
+  if (   NextRunRow < NUM_LCD_ROWS 
+      && GetNextRowRun(&FirstRow,&TotalRows) )
+  {
+    StartLcdDma(pRowRunBuffer + FirstRow*sizeof(tLcdLine),
+                TotalRows*sizeof(tLcdLine));
+    return;
+  }
+#endif
+  
   LcdDmaBusy = 0;
+  
+  /* the waiting task runs on the next tick (see SendMessageToQueueFromIsr) */
+  xSemaphoreGiveFromISR(LcdDmaSemaphore,&HigherPriorityTaskWoken);
 }
@@ -45,9 +45,47 @@ void ClearLcd(void);
  */
 void UpdateMyDisplay(unsigned char * pBuffer,unsigned int TotalLines);
 
+/*! Start drawing the display generated by the watch firmware and return
+ * while the DMA is running.  The buffer must not be changed until 
+ * WaitForMyDisplayUpdate has been called.
+ *
+ * \param pBuffer is a pointer to the buffer to draw (of type tLcdLine)
+ * \param is the total number of lines to draw
+ */
+void StartMyDisplayUpdate(unsigned char * pBuffer,unsigned int TotalLines);
+
+/*! Wait for the update started by StartMyDisplayUpdate to finish.  The
+ * calling task blocks on the DMA completion instead of polling.
+ */
+void WaitForMyDisplayUpdate(void);
+
+/*! 
+ * \return 1 if a DMA transfer to the LCD is in progress
+ */
+unsigned char QueryLcdDmaBusy(void);
+
+/*! Draw the rows of the display generated by the watch firmware that are set
+ * in a row map.  Adjacent rows are grouped into runs and each run is sent 
+ * with a single DMA transfer.
+ *
+ * \param pBuffer is a pointer to the buffer to draw (of type tLcdLine)
+ * \param pRowMap is a bitmap with one bit for each row (LCD_ROW_MAP_BYTES)
+ */
+void UpdateMyDisplayRows(unsigned char * pBuffer,unsigned char const * pRowMap);
+
+/*! Start drawing the rows that are set in a row map and return while the 
+ * DMA is running.  The DMA interrupt starts each run of rows in turn.  The 
+ * buffer must not be changed until WaitForMyDisplayUpdate has been called.
+ *
+ * \param pBuffer is a pointer to the buffer to draw (of type tLcdLine)
+ * \param pRowMap is a bitmap with one bit for each row (it is copied)
+ */
+void StartMyDisplayRowsUpdate(unsigned char * pBuffer,
+                              unsigned char const * pRowMap);
+
 
 /*! Callback from the DMA interrupt service routing that lets LCD task know 
- * that the dma has finished
+ * that the dma has finished (gives the semaphore the task is waiting on)
  */
 void LcdDmaIsr(void);
 
@@ -38,6 +38,137 @@ static void AllQueuesReadyCheck(void);
 #endif
 
 static void SendMsgToQ(unsigned char Qindex, tMessage* pMsg);
+static unsigned char IsUrgentMsg(unsigned char Type);
+static unsigned char GoesToFront(unsigned char Qindex, tMessage* pMsg);
+static void UrgentNotQueued(unsigned char Qindex, tMessage* pMsg);
+
+/* 
+ * Messages caused by the buttons go to the front of their queue so that the
+ * user does not wait for a burst of screen data from the phone.  After this
+ * many of them in a row the next one waits its turn so that the other
+ * messages still make progress.
+ */
+#define MAX_URGENT_IN_A_ROW ( 4 )
+
+static unsigned char UrgentInARow[TOTAL_QUEUES];
+
+/* urgent messages that have been sent to a queue and not received yet */
+static unsigned char UrgentQueued[TOTAL_QUEUES];
+
+/*
+ * Periodic messages that only ask a task to bring something up to date.  When
+ * one of them is still waiting in a queue another one is dropped.
+ */
+static unsigned char PendingBit(tMessage* pMsg);
+static unsigned char AlreadyPending(unsigned char Qindex, tMessage* pMsg);
+
+static unsigned char Pending[TOTAL_QUEUES];
+
+/* a message type is one byte */
+#define TOTAL_MESSAGE_TYPES ( 256 )
+
+/* 
+ * The queue that each message type is routed to.  Types that are not in the
+ * table are sent to the free queue (FREE_QINDEX is 0).
+ */
+static const unsigned char RouteTable[TOTAL_MESSAGE_TYPES] =
+{
+  [GetDeviceType]                = BACKGROUND_QINDEX,
+  [GetDeviceTypeResponse]        = SPP_TASK_QINDEX,
+  [GetInfoString]                = BACKGROUND_QINDEX,
+  [GetInfoStringResponse]        = SPP_TASK_QINDEX,
+  [DiagnosticLoopback]           = SPP_TASK_QINDEX,
+  [EnterShippingModeMsg]         = SPP_TASK_QINDEX,
+  [SoftwareResetMsg]             = BACKGROUND_QINDEX,
+  [ConnectionTimeoutMsg]         = SPP_TASK_QINDEX,
+  [TurnRadioOnMsg]               = SPP_TASK_QINDEX,
+  [TurnRadioOffMsg]              = SPP_TASK_QINDEX,
+  [ReadRssiMsg]                  = SPP_TASK_QINDEX,
+  [PairingControlMsg]            = SPP_TASK_QINDEX,
+  [ReadRssiResponseMsg]          = SPP_TASK_QINDEX,
+  [SniffControlMsg]              = SPP_TASK_QINDEX,
+  [LinkAlarmMsg]                 = DISPLAY_QINDEX,
+  [OledWriteBufferMsg]           = DISPLAY_QINDEX,
+  [OledConfigureModeMsg]         = DISPLAY_QINDEX,
+  [OledChangeModeMsg]            = DISPLAY_QINDEX,
+  [OledWriteScrollBufferMsg]     = DISPLAY_QINDEX,
+  [OledScrollMsg]                = DISPLAY_QINDEX,
+  [OledShowIdleBufferMsg]        = DISPLAY_QINDEX,
+  [OledCrownMenuMsg]             = DISPLAY_QINDEX,
+  [OledCrownMenuButtonMsg]       = DISPLAY_QINDEX,
+  [AdvanceWatchHandsMsg]         = BACKGROUND_QINDEX,
+  [SetVibrateMode]               = BACKGROUND_QINDEX,
+  [ButtonStateMsg]               = BACKGROUND_QINDEX,
+  [SetRealTimeClock]             = BACKGROUND_QINDEX,
+  [GetRealTimeClock]             = BACKGROUND_QINDEX,
+  [GetRealTimeClockResponse]     = SPP_TASK_QINDEX,
+  [StatusChangeEvent]            = SPP_TASK_QINDEX,
+  [NvalOperationMsg]             = BACKGROUND_QINDEX,
+  [NvalOperationResponseMsg]     = SPP_TASK_QINDEX,
+  [GeneralPurposePhoneMsg]       = SPP_TASK_QINDEX,
+  [GeneralPurposeWatchMsg]       = BACKGROUND_QINDEX,
+  [ButtonEventMsg]               = SPP_TASK_QINDEX,
+  [WriteBuffer]                  = DISPLAY_QINDEX,
+  [ConfigureDisplay]             = DISPLAY_QINDEX,
+  [ConfigureIdleBufferSize]      = DISPLAY_QINDEX,
+  [UpdateDisplay]                = DISPLAY_QINDEX,
+  [LoadTemplate]                 = DISPLAY_QINDEX,
+  [EnableButtonMsg]              = BACKGROUND_QINDEX,
+  [DisableButtonMsg]             = BACKGROUND_QINDEX,
+  [ReadButtonConfigMsg]          = BACKGROUND_QINDEX,
+  [ReadButtonConfigResponse]     = BACKGROUND_QINDEX,
+  [BatteryChargeControl]         = BACKGROUND_QINDEX,
+  [AlarmControl]                 = BACKGROUND_QINDEX,
+  [IdleUpdate]                   = DISPLAY_QINDEX,
+  [WatchDrawnScreenTimeout]      = DISPLAY_QINDEX,
+  [SplashTimeoutMsg]             = DISPLAY_QINDEX,
+  [SaveSettingsAndResetMsg]      = DISPLAY_QINDEX,
+  [ChangeModeMsg]                = DISPLAY_QINDEX,
+  [ModeTimeoutMsg]               = DISPLAY_QINDEX,
+  [WatchStatusMsg]               = DISPLAY_QINDEX,
+  [MenuModeMsg]                  = DISPLAY_QINDEX,
+  [BarCode]                      = DISPLAY_QINDEX,
+  [ShowCalendarMsg]              = DISPLAY_QINDEX,
+  [ConnectionStateChangeMsg]     = DISPLAY_QINDEX,
+  [ModifyTimeMsg]                = DISPLAY_QINDEX,
+  [MenuButtonMsg]                = DISPLAY_QINDEX,
+  [ToggleSecondsMsg]             = DISPLAY_QINDEX,
+  [CalendarMsg]                  = DISPLAY_QINDEX,
+  [LedChange]                    = BACKGROUND_QINDEX,
+  [AccelerometerHostMsg]         = SPP_TASK_QINDEX,
+  [AccelerometerEnableMsg]       = BACKGROUND_QINDEX,
+  [AccelerometerDisableMsg]      = BACKGROUND_QINDEX,
+  [AccelerometerSendDataMsg]     = BACKGROUND_QINDEX,
+  [AccelerometerAccessMsg]       = BACKGROUND_QINDEX,
+  [AccelerometerResponseMsg]     = BACKGROUND_QINDEX,
+  [AccelerometerSetupMsg]        = BACKGROUND_QINDEX,
+  [QueryMemoryMsg]               = SPP_TASK_QINDEX,
+  [RamTestMsg]                   = DISPLAY_QINDEX,
+  [RateTestMsg]                  = BACKGROUND_QINDEX,
+  [BatteryConfigMsg]             = BACKGROUND_QINDEX,
+  [LowBatteryWarningMsgHost]     = SPP_TASK_QINDEX,
+  [LowBatteryBtOffMsgHost]       = SPP_TASK_QINDEX,
+  [ReadBatteryVoltageMsg]        = BACKGROUND_QINDEX,
+  [ReadBatteryVoltageResponse]   = SPP_TASK_QINDEX,
+  [ReadLightSensorMsg]           = BACKGROUND_QINDEX,
+  [ReadLightSensorResponse]      = SPP_TASK_QINDEX,
+  [LowBatteryWarningMsg]         = DISPLAY_QINDEX,
+  [LowBatteryBtOffMsg]           = DISPLAY_QINDEX,
+  [AdvertisingDataMsg]           = SPP_TASK_QINDEX,
+  [CallbackTimeoutMsg]           = SPP_TASK_QINDEX,
+  [SetCallbackTimerMsg]          = BACKGROUND_QINDEX,
+  [RadioPowerControlMsg]         = SPP_TASK_QINDEX,
+  [DiaryWriteRecord]             = BACKGROUND_QINDEX,
+  [DiaryWriteEnd]                = BACKGROUND_QINDEX,
+  [DiarySyncMsg]                 = BACKGROUND_QINDEX,
+  [ShowDiaryMsg]                 = BACKGROUND_QINDEX,
+  [DiaryWriteEndResponse]        = SPP_TASK_QINDEX
+};
+
+#ifdef CHECK_ROUTE_USAGE
+/* number of messages of each type that have been routed */
+static unsigned int MessageRouteCount[TOTAL_MESSAGE_TYPES];
+#endif
 
 xQueueHandle QueueHandles[TOTAL_QUEUES];
 
@@ -69,8 +200,9 @@ static void AllQueuesReadyCheck(void)
   {
     unsigned char Result = 1;
     
+    /* the free buffers are not kept in a queue */
     unsigned char i;
-    for (i = 0; i < TOTAL_QUEUES; i++ )
+    for (i = FREE_QINDEX + 1; i < TOTAL_QUEUES; i++ )
     {
       if ( QueueHandles[i] == NULL )
       {
@@ -106,12 +238,45 @@ void PrintQueueNameIsFull(unsigned char Qindex)
 /* if the queue is full, don't wait */
 static void SendMsgToQ(unsigned char Qindex, tMessage* pMsg)
 {
+  signed portBASE_TYPE Result;
+  unsigned char Drop;
+  unsigned char Front = 0;
+
   if ( Qindex == FREE_QINDEX )
   {
     SendToFreeQueue(pMsg);  
+    return;
+  }
+
+  portENTER_CRITICAL();
+  Drop = AlreadyPending(Qindex,pMsg);
+  if ( Drop == 0 )
+  {
+    Front = GoesToFront(Qindex,pMsg);
+  }
+  portEXIT_CRITICAL();
+  
+  if ( Drop )
+  {
+    return;
+  }
+
+  if ( Front )
+  {
+    Result = xQueueSendToFront(QueueHandles[Qindex],pMsg,DONT_WAIT);
   }
-  else if ( errQUEUE_FULL ==  xQueueSend(QueueHandles[Qindex],pMsg,DONT_WAIT) )
+  else
   {
+    Result = xQueueSend(QueueHandles[Qindex],pMsg,DONT_WAIT);
+  }
+
+  if ( errQUEUE_FULL == Result )
+  {
+    portENTER_CRITICAL();
+    Pending[Qindex] &= ~PendingBit(pMsg);
+    UrgentNotQueued(Qindex,pMsg);
+    portEXIT_CRITICAL();
+    
     PrintQueueNameIsFull(Qindex);
     SendToFreeQueue(pMsg);
   }
@@ -140,15 +305,36 @@ static void SendMessageToQueueWait(unsigned char Qindex, tMessage* pMsg)
 void SendMessageToQueueFromIsr(unsigned char Qindex, tMessage* pMsg)
 {
   signed portBASE_TYPE HigherPriorityTaskWoken;
+  signed portBASE_TYPE Result;
   
   if ( Qindex == FREE_QINDEX )
   {
     SendToFreeQueueIsr(pMsg);  
+    return;
+  }
+
+  if ( AlreadyPending(Qindex,pMsg) )
+  {
+    return;
+  }
+
+  if ( GoesToFront(Qindex,pMsg) )
+  {
+    Result = xQueueSendToFrontFromISR(QueueHandles[Qindex],
+                                      pMsg,
+                                      &HigherPriorityTaskWoken);
   }
-  else if ( errQUEUE_FULL == xQueueSendFromISR(QueueHandles[Qindex],
-                                               pMsg,
-                                               &HigherPriorityTaskWoken))
+  else
   {
+    Result = xQueueSendFromISR(QueueHandles[Qindex],
+                               pMsg,
+                               &HigherPriorityTaskWoken);
+  }
+
+  if ( errQUEUE_FULL == Result )
+  {
+    Pending[Qindex] &= ~PendingBit(pMsg);
+    UrgentNotQueued(Qindex,pMsg);
     PrintQueueNameIsFull(Qindex);
     SendToFreeQueueIsr(pMsg);
   }
@@ -169,6 +355,125 @@ void SendMessageToQueueFromIsr(unsigned char Qindex, tMessage* pMsg)
   
 }
 
+static unsigned char IsUrgentMsg(unsigned char Type)
+{
+  unsigned char result = 0;
+  
+  switch (Type)
+  {
+  case ButtonStateMsg:
+  case MenuButtonMsg:
+  case MenuModeMsg:
+  case ChangeModeMsg:
+  case ModifyTimeMsg:
+  case ShowCalendarMsg:
+  case CalendarMsg:
+  case WatchStatusMsg:
+  case ToggleSecondsMsg:
+    result = 1;
+    break;
+    
+  default:
+    break;
+  }
+  
+  return result;
+}
+
+/* 
+ * An urgent message only goes to the front when no other urgent message is
+ * still queued, so that button presses are handled in order.  The message is
+ * counted as queued here.
+ *
+ * interrupts must be disabled
+ */
+static unsigned char GoesToFront(unsigned char Qindex, tMessage* pMsg)
+{
+  unsigned char Front;
+  
+  if ( IsUrgentMsg(pMsg->Type) == 0 )
+  {
+    return 0;
+  }
+  
+  Front = (   UrgentQueued[Qindex] == 0
+           && UrgentInARow[Qindex] < MAX_URGENT_IN_A_ROW );
+  
+  UrgentQueued[Qindex]++;
+  
+  return Front;
+}
+
+/* an urgent message was received or did not fit, interrupts must be disabled */
+static void UrgentNotQueued(unsigned char Qindex, tMessage* pMsg)
+{
+  if ( IsUrgentMsg(pMsg->Type) && UrgentQueued[Qindex] > 0 )
+  {
+    UrgentQueued[Qindex]--;
+  }
+}
+
+/* only messages without a buffer or options can be dropped */
+static unsigned char PendingBit(tMessage* pMsg)
+{
+  unsigned char result = 0;
+  
+  if ( pMsg->pBuffer != 0 || pMsg->Options != NO_MSG_OPTIONS )
+  {
+    return 0;
+  }
+  
+  switch (pMsg->Type)
+  {
+  case IdleUpdate:            result = BIT0; break;
+  case BatteryChargeControl:  result = BIT1; break;
+  case AlarmControl:          result = BIT2; break;
+  case ButtonStateMsg:        result = BIT3; break;
+  case ShowDiaryMsg:          result = BIT4; break;
+  default:                                   break;
+  }
+  
+  return result;
+}
+
+/* interrupts must be disabled */
+static unsigned char AlreadyPending(unsigned char Qindex, tMessage* pMsg)
+{
+  unsigned char Bit = PendingBit(pMsg);
+  
+  if ( Bit == 0 )
+  {
+    return 0;
+  }
+  
+  if ( Pending[Qindex] & Bit )
+  {
+    gAppStats.CoalescedMessages++;
+    return 1;
+  }
+  
+  Pending[Qindex] |= Bit;
+  return 0;
+}
+
+void CountReceivedMsg(unsigned char Qindex, tMessage* pMsg)
+{
+  /* from now on a new message of the same type has to be queued */
+  portENTER_CRITICAL();
+  Pending[Qindex] &= ~PendingBit(pMsg);
+  UrgentNotQueued(Qindex,pMsg);
+  portEXIT_CRITICAL();
+  
+  if ( IsUrgentMsg(pMsg->Type) == 0 )
+  {
+    UrgentInARow[Qindex] = 0;
+  }
+  else if ( UrgentInARow[Qindex] < MAX_URGENT_IN_A_ROW )
+  {
+    UrgentInARow[Qindex]++;
+  }
+}
+
 static unsigned char LastMessageType = 0;
 static unsigned char AddNewline = 0;
 
@@ -253,6 +558,7 @@ void PrintMessageType(tMessage* pMsg)
   case IdleUpdate:                 PrintStringAndHexByte("IdleUpdate 0x",MessageType);             break;
   case WatchDrawnScreenTimeout:    PrintStringAndHexByte("WatchDrawnScreenTimeout 0x",MessageType);break;
   case SplashTimeoutMsg:           PrintStringAndHexByte("SplashTimeoutMsg 0x",MessageType);       break;
+  case SaveSettingsAndResetMsg:    PrintStringAndHexByte("SaveSettingsAndResetMsg 0x",MessageType); break;
   case ChangeModeMsg:              PrintStringAndHexByte("ChangeModeMsg 0x",MessageType);          break;
   case ModeTimeoutMsg:             PrintStringAndHexByte("ModeTimeoutMsg 0x",MessageType);         break;
   case WatchStatusMsg:             PrintStringAndHexByte("WatchStatusMsg 0x",MessageType);         break;
@@ -293,6 +599,8 @@ void PrintMessageType(tMessage* pMsg)
   
   case DiaryWriteRecord:           PrintStringAndHexByte("DiaryWriteRecord 0x",MessageType);           break;
   case DiaryWriteEnd:              PrintStringAndHexByte("DiaryWriteEnd 0x",MessageType);              break;
+  case DiarySyncMsg:               PrintStringAndHexByte("DiarySyncMsg 0x",MessageType);               break;
+  case DiaryWriteEndResponse:      PrintStringAndHexByte("DiaryWriteEndResponse 0x",MessageType);      break;
   
   
   default:                         PrintStringAndHexByte("Unknown Message Type 0x",MessageType);       break;
@@ -319,100 +627,11 @@ void RouteMsg(tMessage* pMsg)
   else
 #endif
   {
-
-    switch (pMsg->Type)
-    {
-    case InvalidMessage:                SendMsgToQ(FREE_QINDEX,pMsg);       break;
-    case GetDeviceType:                 SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case GetDeviceTypeResponse:         SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case GetInfoString:                 SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case GetInfoStringResponse:         SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case DiagnosticLoopback:            SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case EnterShippingModeMsg:          SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case SoftwareResetMsg:              SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case ConnectionTimeoutMsg:          SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case TurnRadioOnMsg:                SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case TurnRadioOffMsg:               SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case ReadRssiMsg:                   SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case PairingControlMsg:             SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case ReadRssiResponseMsg:           SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case SniffControlMsg:               SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case LinkAlarmMsg:                  SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case OledWriteBufferMsg:            SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case OledConfigureModeMsg:          SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case OledChangeModeMsg:             SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case OledWriteScrollBufferMsg:      SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case OledScrollMsg:                 SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case OledShowIdleBufferMsg:         SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case OledCrownMenuMsg:              SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case OledCrownMenuButtonMsg:        SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case AdvanceWatchHandsMsg:          SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case SetVibrateMode:                SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case ButtonStateMsg:                SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case SetRealTimeClock:              SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case GetRealTimeClock:              SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case GetRealTimeClockResponse:      SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case StatusChangeEvent:             SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case NvalOperationMsg:              SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case NvalOperationResponseMsg:      SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case GeneralPurposePhoneMsg:        SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case GeneralPurposeWatchMsg:        SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case ButtonEventMsg:                SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case WriteBuffer:                   SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case ConfigureDisplay:              SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case ConfigureIdleBufferSize:       SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case UpdateDisplay:                 SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case LoadTemplate:                  SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case EnableButtonMsg:               SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case DisableButtonMsg:              SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case ReadButtonConfigMsg:           SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case ReadButtonConfigResponse:      SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case BatteryChargeControl:          SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case AlarmControl:                  SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case IdleUpdate:                    SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case WatchDrawnScreenTimeout:       SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case SplashTimeoutMsg:              SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case ChangeModeMsg:                 SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case ModeTimeoutMsg:                SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case WatchStatusMsg:                SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case MenuModeMsg:                   SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case BarCode:                       SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case ShowCalendarMsg:               SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case ConnectionStateChangeMsg:      SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case ModifyTimeMsg:                 SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case MenuButtonMsg:                 SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case ToggleSecondsMsg:              SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case CalendarMsg:                   SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case LedChange:                     SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case AccelerometerHostMsg:          SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case AccelerometerEnableMsg:        SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case AccelerometerDisableMsg:       SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;       
-    case AccelerometerSendDataMsg:      SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;        
-    case AccelerometerAccessMsg:        SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;        
-    case AccelerometerResponseMsg:      SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;        
-    case AccelerometerSetupMsg:         SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case QueryMemoryMsg:                SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case RamTestMsg:                    SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case RateTestMsg:                   SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case BatteryConfigMsg:              SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case LowBatteryWarningMsgHost:      SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case LowBatteryBtOffMsgHost:        SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case ReadBatteryVoltageMsg:         SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case ReadBatteryVoltageResponse:    SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case ReadLightSensorMsg:            SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case ReadLightSensorResponse:       SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case LowBatteryWarningMsg:          SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case LowBatteryBtOffMsg:            SendMsgToQ(DISPLAY_QINDEX,pMsg);    break;
-    case AdvertisingDataMsg:            SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case CallbackTimeoutMsg:            SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    case SetCallbackTimerMsg:           SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case RadioPowerControlMsg:          SendMsgToQ(SPP_TASK_QINDEX,pMsg);   break;
-    
-    case DiaryWriteRecord:              SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
-    case DiaryWriteEnd:                 SendMsgToQ(BACKGROUND_QINDEX,pMsg); break;
+#ifdef CHECK_ROUTE_USAGE
+    MessageRouteCount[pMsg->Type]++;
+#endif
     
-    default:                            SendMsgToQ(FREE_QINDEX,pMsg);       break;
-    }
+    SendMsgToQ(RouteTable[pMsg->Type],pMsg);
   }
   
 }
@@ -79,6 +79,18 @@ void RouteMsg(tMessage* pMsg);
  */
 void SendMessageToQueueFromIsr(unsigned char Qindex,tMessage* pMsg);
 
+/*! A task calls this for each message it takes from its queue.  Messages
+ * from the buttons go to the front of a queue and this keeps count of them so
+ * that they cannot keep the other messages waiting forever, and of how many
+ * are still queued so that they stay in order.  It also lets the
+ * next periodic update message (e.g. IdleUpdate) into the queue, while one is
+ * waiting the others are dropped.
+ *
+ * \param Qindex is the queue the message was taken from
+ * \param pMsg A pointer to the message
+ */
+void CountReceivedMsg(unsigned char Qindex, tMessage* pMsg);
+
 /*! Let routing know handle of wrapper queue.  This function is used so that the
  * number of queues can change without affecting the stack.
  *
@@ -263,7 +263,7 @@ typedef enum
   IdleUpdate = 0xa0,
   WatchDrawnScreenTimeout = 0xa2,
   SplashTimeoutMsg = 0xa3,
-  Unused_0xa4 = 0xa4,
+  SaveSettingsAndResetMsg = 0xa4,
   Unused_0xa5 = 0xa5,
   ChangeModeMsg = 0xa6,
   ModeTimeoutMsg = 0xa7,
@@ -288,6 +288,8 @@ typedef enum
   DiaryIsEmptyRecord = 0xbc,
   DiaryWriteRecord = 0xbd,
   DiaryWriteEnd = 0xbe,
+  DiarySyncMsg = 0xbf,
+  DiaryWriteEndResponse = 0xb9,
     
   LedChange = 0xc0,
 
@@ -512,6 +514,11 @@ typedef enum
 #define NVAL_WRITE_OPERATION    ( 0x02 )
 #define NVAL_RESERVED_OPERATION ( 0x03 )
 
+/*! The response to the statistics operation is the identifier followed by
+ * the nval index hits, misses and entries compared (32 bits each, lsb first)
+ */
+#define NVAL_STATISTICS_OPERATION ( 0x04 )
+
 /*! NvalOperationPayload
  *
  * \param NvalIdentifier is the 16 bit id of an NVAL item
@@ -708,6 +715,65 @@ typedef struct
 #define CALENDAR_MONTH_PLUS       ( 1 )
 #define CALENDAR_MONTH_MINUS      ( 2 )
 #define CALENDAR_EDIT             ( 3 )
+/****Diary*********************************************************************/
+
+/*! Options for DiaryWriteRecord
+ *
+ * Bits 0-6 are the cell number (0-127) and bit 7 is set when the payload is
+ * the text of the record rather than its header.  Firmware that kept its 
+ * records in internal RAM only looked at bits 0-5, so bit 6 was ignored there
+ * and a cell number of 64 or more wrote cell (number - 64).  Cells past the
+ * capacity in DiaryWriteEndResponse are ignored.
+ */
+#define DIARY_RECORD_CELL_MASK   ( 0x7f )
+#define DIARY_RECORD_TEXT_OPTION ( BIT7 )
+
+/*! Options for the diary sync message
+ *
+ * A sync replaces the whole diary as one transaction.  The first packet must
+ * have DIARY_SYNC_CLEAR_OPTION and starts an empty copy of the diary.  The
+ * diary shown and saved is replaced only when the packet with 
+ * DIARY_SYNC_END_OPTION arrives, so a sync that is not finished leaves the
+ * old diary as it was.  One packet can have both options.  Packets that are
+ * not part of a sync are ignored, and DiaryWriteRecord changes made during a
+ * sync are lost when it ends.  A watch with too little serial RAM for two
+ * copies of the diary keeps a single copy, and there a DiaryWriteRecord 
+ * cancels the sync instead.
+ *
+ * The payload is records one after the other: record number, the five packed
+ * header bytes (same format as stored) and up to 20 bytes of text.  Text that
+ * is shorter than 20 bytes ends with 0.  The length of a message is not sent,
+ * so the last record must be followed by DIARY_SYNC_NO_RECORD.  The only
+ * exception is a packet that holds a single record which fills the whole 
+ * payload.  A packet that does not follow this cancels the sync.
+ */
+#define DIARY_SYNC_CLEAR_OPTION ( BIT0 )
+#define DIARY_SYNC_END_OPTION   ( BIT1 )
+
+#define DIARY_SYNC_NO_RECORD    ( 0xff )
+
+/*! Reply to DiaryWriteEnd and to the last packet of a diary sync
+ *
+ * \param Capacity is the number of diary cells
+ * \param PersistentCells is the number of cells, starting at cell 0, that are 
+ * kept in flash.  The other cells are lost when the watch resets and the phone
+ * has to send them again.
+ * \param UsedCells is the number of cells in use
+ * \param VolatileCells is the number of cells in use that are not kept in
+ * flash
+ *
+ * \note DiaryWriteEnd without any records before it can be used to ask for
+ * this reply, for example to find out if cells were lost after a reset.
+ */
+typedef struct
+{
+  unsigned char Capacity;
+  unsigned char PersistentCells;
+  unsigned char UsedCells;
+  unsigned char VolatileCells;
+
+} tDiaryStatusPayload;
+
 /******************************************************************************/
 typedef struct
 {
@@ -496,6 +496,8 @@ static void DisplayTask(void *pvParameters)
   {
     if( xQueueReceive(QueueHandles[DISPLAY_QINDEX], &DisplayMsg, portMAX_DELAY) )
     {
+      CountReceivedMsg(DISPLAY_QINDEX,&DisplayMsg);
+
       DisplayQueueMessageHandler(&DisplayMsg);
       
       SendToFreeQueue(&DisplayMsg);
@@ -59,6 +59,12 @@
 /* keep track of maximum queue depth */
 #undef CHECK_QUEUE_USAGE
 
+/* count the number of messages routed of each type */
+#undef CHECK_ROUTE_USAGE
+
+/* fill the whole diary when a rate test message arrives and report the time */
+#undef DIARY_SYNC_TEST
+
 /* use debug pin 5 on development board to keep track of when SMCLK is on */
 #undef CLOCK_CONTROL_DEBUG
 
@@ -24,6 +24,7 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
+#include "semphr.h"
 
 #include "hal_board_type.h"
 #include "hal_clock_control.h"
@@ -74,6 +75,19 @@ static tLcdMessagePayload WriteLineBuffer;
 /* command and two addres bytes */
 #define SPI_OVERHEAD ( 3 )
 
+/* idle, application, notification and scroll each have an active and draw */
+#define TOTAL_SRAM_BUFFERS   ( 8 )
+
+/* 
+ * the storage starts where the second scroll buffer ends (each scroll buffer
+ * is half a screen, see GetDrawBufferStartAddress)
+ */
+#define STORAGE_START_ADDRESS ( BYTES_PER_SCREEN*(TOTAL_SRAM_BUFFERS-1) )
+
+/* 64Kbit and 256Kbit parts */
+#define SRAM_SIZE     ( (unsigned long)8192 )
+#define SRAM_SIZE_256 ( (unsigned long)32768 )
+
 /******************************************************************************/
 
 #define FREE_BUFFER        ( 1 )
@@ -85,6 +99,7 @@ static void WriteBlockToSram(unsigned char* pData,unsigned int Size);
 static void ReadBlock(unsigned char* pWriteData,unsigned char* pReadData);
 static void ActivateBuffer(tMessage* pMsg);
 static void WaitForDmaEnd(void);
+static void ReadBlockFromSram(unsigned char* pData,unsigned int Size);
 
 /******************************************************************************/
 unsigned char GetStartingRow(unsigned char MsgOptions);
@@ -103,6 +118,13 @@ static unsigned char NotificationDrawBuffer;
 static unsigned char ScrollActiveBuffer;
 static unsigned char ScrollDrawBuffer;
 
+/*
+ * The display task draws into the screen buffers and the background task
+ * reads and writes the storage above them (the diary)
+ */
+static xSemaphoreHandle SerialRamMutex;
+static unsigned int StorageSize;
+
 /******************************************************************************/
 
 void SerialRamInit(void)
@@ -113,6 +135,9 @@ void SerialRamInit(void)
   
   /* assert reset when configuring */
   UCA0CTL1 = UCSWRST;  
+
+  /* a mutex is created available */
+  SerialRamMutex = xSemaphoreCreateMutex();
  
   EnableSmClkUser(SERIAL_RAM_USER);
   
@@ -152,11 +177,13 @@ void SerialRamInit(void)
   
   unsigned char FinalSrValue = DEFAULT_SR_VALUE;
   unsigned char DefaultSrValue = FINAL_SR_VALUE;
+  unsigned long SramSize = SRAM_SIZE;
   
   if ( GetBoardConfiguration() >= 5 )
   {
     DefaultSrValue = DEFAULT_SR_VALUE_256;
     FinalSrValue = FINAL_SR_VALUE_256;  
+    SramSize = SRAM_SIZE_256;
   }
   
   /* make sure correct value is read from the part */
@@ -213,6 +240,13 @@ void SerialRamInit(void)
   ScrollActiveBuffer = 6;
   ScrollDrawBuffer = 7;
   
+  /* only the first 8K are cleared, users of the storage keep track of it */
+  StorageSize = 0;
+  if ( SramSize > STORAGE_START_ADDRESS )
+  {
+    StorageSize = (unsigned int)(SramSize - STORAGE_START_ADDRESS);
+  }
+
 }
 
 /* see tSerialRamMsgPayload for the payload formatting 
@@ -239,6 +273,8 @@ void WriteBufferHandler(tMessage* pMsg)
    */
   unsigned int BufferAddress = GetDrawBufferStartAddress(MsgOptions);
   unsigned int AbsoluteAddress = BufferAddress + (RowA*BYTES_PER_LINE);
+
+  xSemaphoreTake(SerialRamMutex,portMAX_DELAY);
   
   pWorkingBuffer[0] = SPI_WRITE;
   pWorkingBuffer[1] = (unsigned char)(AbsoluteAddress >> 8);
@@ -273,6 +309,8 @@ void WriteBufferHandler(tMessage* pMsg)
     /* point to first character to dma */
     WriteBlockToSram(pWorkingBuffer,15);
   }
+
+  xSemaphoreGive(SerialRamMutex);
   
 }
 
@@ -413,6 +451,34 @@ static void ReadBlock(unsigned char* pWriteData,unsigned char* pReadData)
   
 }
 
+/*
+ * read a block after SetupCycle has sent the command and address
+ * (the receive flag is clear so the data is not offset)
+ */
+static void ReadBlockFromSram(unsigned char* pData,unsigned int Size)
+{
+  DmaBusy = 1;
+  DummyData = 0;
+
+  DMACTL0 = DMA1TSEL_16 | DMA0TSEL_17;
+
+  /* transmit the same dummy byte for every byte that is read */
+  __data16_write_addr((unsigned short) &DMA0SA,(unsigned long) &DummyData);
+  __data16_write_addr((unsigned short) &DMA0DA,(unsigned long) &UCA0TXBUF);
+  DMA0SZ = Size;
+  DMA0CTL = DMADT_0 + DMASBDB + DMALEVEL;
+
+  __data16_write_addr((unsigned short) &DMA1SA,(unsigned long) &UCA0RXBUF);
+  __data16_write_addr((unsigned short) &DMA1DA,(unsigned long) pData);
+  DMA1SZ = Size;
+  DMA1CTL = DMADT_0 + DMADSTINCR_3 + DMASBDB + DMALEVEL + DMAIE;
+
+  DMA1CTL |= DMAEN;
+  DMA0CTL |= DMAEN;
+
+  WaitForDmaEnd();
+
+}
 
 static void ClearMemory(void)
 {  
@@ -477,6 +543,8 @@ void UpdateDisplayHandler(tMessage* pMsg)
   /* update address because of possible starting row change */
   AbsoluteAddress += BYTES_PER_LINE*LcdRow;
   AbsoluteDrawAddress += BYTES_PER_LINE*LcdRow;
+  
+  xSemaphoreTake(SerialRamMutex,portMAX_DELAY);
        
   /* A possible change would be store dirty bits at the beginning of the buffer
    * after reading this only the rows that changed would be read out and 
@@ -526,6 +594,8 @@ void UpdateDisplayHandler(tMessage* pMsg)
 
   }
   
+  xSemaphoreGive(SerialRamMutex);
+
   /* now that the screen has been drawn put the LCD into a lower power mode */
   PutLcdIntoStaticMode();
   
@@ -552,6 +622,8 @@ void LoadTemplateHandler(tMessage* pMsg)
   /* now calculate the absolute address */
   unsigned int AbsoluteAddress = BufferAddress;
   
+  xSemaphoreTake(SerialRamMutex,portMAX_DELAY);
+  
   /* 
    * templates don't have extra space in them for additional 3 bytes of 
    * cmd and address
@@ -580,6 +652,8 @@ void LoadTemplateHandler(tMessage* pMsg)
       ClearBufferInSram(AbsoluteAddress,0xff,BYTES_PER_SCREEN);  
     }
   }
+
+  xSemaphoreGive(SerialRamMutex);
   
 }
 
@@ -715,6 +789,57 @@ unsigned int GetDrawBufferStartAddress(unsigned char MsgOptions)
   return BufferStartAddress;
 }
 
+unsigned int GetSerialRamStorageSize(void)
+{
+  return StorageSize;
+}
+
+void ReadSerialRamStorage(unsigned int Offset,
+                          unsigned char* pData,
+                          unsigned char Size)
+{
+  if ( Size == 0 || (unsigned long)Offset + Size > StorageSize )
+  {
+    return;
+  }
+
+  xSemaphoreTake(SerialRamMutex,portMAX_DELAY);
+
+  SetupCycle(STORAGE_START_ADDRESS + Offset,SPI_READ);
+  ReadBlockFromSram(pData,Size);
+
+  xSemaphoreGive(SerialRamMutex);
+}
+
+void WriteSerialRamStorage(unsigned int Offset,
+                           unsigned char const* pData,
+                           unsigned char Size)
+{
+  if ( Size == 0 || (unsigned long)Offset + Size > StorageSize )
+  {
+    return;
+  }
+
+  xSemaphoreTake(SerialRamMutex,portMAX_DELAY);
+
+  DmaBusy = 1;
+  SetupCycle(STORAGE_START_ADDRESS + Offset,SPI_WRITE);
+
+  /* USCIA0 TXIFG is the DMA trigger */
+  DMACTL0 = DMA0TSEL_17;
+
+  __data16_write_addr((unsigned short) &DMA0SA,(unsigned long) pData);
+  __data16_write_addr((unsigned short) &DMA0DA,(unsigned long) &UCA0TXBUF);
+  DMA0SZ = Size;
+  DMA0CTL = DMADT_0 + DMASRCINCR_3 + DMASBDB + DMALEVEL + DMAIE;
+
+  DMA0CTL |= DMAEN;
+
+  WaitForDmaEnd();
+
+  xSemaphoreGive(SerialRamMutex);
+}
+
 
 /* Serial RAM controller uses two dma channels
  * LCD driver task uses one dma channel
@@ -41,6 +41,36 @@ void LoadTemplateHandler(tMessage* pMsg);
 /*! Handle the write buffer message */
 void WriteBufferHandler(tMessage* pMsg);
 
+/*! \return the number of bytes of serial ram above the screen buffers
+ * (zero until the serial ram is initialized)
+ *
+ * This memory is not cleared at startup.
+ */
+unsigned int GetSerialRamStorageSize(void);
+
+/*! Read from the serial ram above the screen buffers
+ *
+ * \param Offset from the start of the storage
+ * \param pData is where the bytes are read to
+ * \param Size is the number of bytes
+ *
+ * \note This can be called from any task but not from an interrupt
+ */
+void ReadSerialRamStorage(unsigned int Offset,
+                          unsigned char* pData,
+                          unsigned char Size);
+
+/*! Write to the serial ram above the screen buffers
+ *
+ * \param Offset from the start of the storage
+ * \param pData points to the bytes to write
+ * \param Size is the number of bytes
+ *
+ * \note This can be called from any task but not from an interrupt
+ */
+void WriteSerialRamStorage(unsigned int Offset,
+                           unsigned char const* pData,
+                           unsigned char Size);
 
 void RamTestHandler(tMessage* pMsg);
 
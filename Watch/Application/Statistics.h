@@ -55,6 +55,20 @@ typedef struct
  *
  * \param BufferPoolFailure indicates that a buffer was not available when a task
  * requested it.
+ *
+ * \param LcdFrameLatency is the number of RTOS ticks from when the display
+ * task received the message to when the frame was on the LCD (last frame)
+ *
+ * \param MaxLcdFrameLatency is the largest LcdFrameLatency
+ *
+ * \param DiarySyncTicks is the number of RTOS ticks from the first to the last
+ * packet of the last diary sync
+ *
+ * \param MaxBuffersInUse is the largest number of message buffers that were
+ * allocated at the same time (high-water mark of the buffer pool)
+ *
+ * \param CoalescedMessages is the number of periodic messages that were
+ * dropped because the same message was already waiting in the queue (counter)
  */
 typedef struct
 {
@@ -62,6 +76,11 @@ typedef struct
   unsigned char BufferPoolFailure;
   unsigned char QueueOverflow;
   unsigned char FllFailure;
+  unsigned int LcdFrameLatency;
+  unsigned int MaxLcdFrameLatency;
+  unsigned int DiarySyncTicks;
+  unsigned char MaxBuffersInUse;
+  unsigned int CoalescedMessages;
   
 } tApplicationStatistics;
 
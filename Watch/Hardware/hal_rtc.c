@@ -171,6 +171,34 @@ void halRtcGet(tRtcHostMsgPayload* pRtcData)
 
 
 
+void halRtcSetAlarm(unsigned char Hour, unsigned char Minute)
+{
+  portENTER_CRITICAL();
+  
+  RTCCTL01 &= ~(RTCAIE | RTCAIFG);
+  
+  /* match on hour and minute only */
+  RTCADOW = 0;
+  RTCADAY = 0;
+  RTCAHOUR = Hour | RTCAE;
+  RTCAMIN = Minute | RTCAE;
+  
+  RTCCTL01 |= RTCAIE;
+  
+  portEXIT_CRITICAL();
+}
+
+void halRtcDisableAlarm(void)
+{
+  portENTER_CRITICAL();
+  
+  RTCCTL01 &= ~(RTCAIE | RTCAIFG);
+  RTCAHOUR = 0;
+  RTCAMIN = 0;
+  
+  portEXIT_CRITICAL();
+}
+
 void EnableRtcPrescaleInterruptUser(unsigned char UserMask)
 {
   portENTER_CRITICAL();
@@ -233,7 +261,11 @@ __interrupt void RTC_ISR(void)
   case RTC_NO_INTERRUPT: break;
   case RTC_RDY_IFG:      break;
   case RTC_EV_IFG:       break;
-  case RTC_A_IFG:        break;
+  case RTC_A_IFG:
+    SetupMessage(&Msg,AlarmControl,NO_MSG_OPTIONS);
+    SendMessageToQueueFromIsr(BACKGROUND_QINDEX,&Msg);
+    ExitLpm = 1;
+    break;
 
   case RTC_PRESCALE_ZERO_IFG:
 
@@ -84,6 +84,17 @@ unsigned char QueryRtcUserActive(unsigned char UserMask);
 // The exact value is 31.25 mS
 #define RTC_TIMER_MS_PER_TICK       31   
 
+/*! Program the RTC alarm.  The alarm interrupt sends an AlarmControl
+ * message to the background task when the time matches.
+ *
+ * \param Hour is the hour of the alarm (0-23)
+ * \param Minute is the minute of the alarm (0-59)
+ */
+void halRtcSetAlarm(unsigned char Hour, unsigned char Minute);
+
+/*! Turn off the RTC alarm */
+void halRtcDisableAlarm(void);
+
 /*! Get the current structure containing the real time clock parameters.
  *
  * \param pRtcData
@@ -0,0 +1,10 @@
+/* host test stand-in: the debug uart output goes to stdout */
+
+#ifndef DEBUG_UART_H
+#define DEBUG_UART_H
+
+#define PrintString(pString)             printf("%s",(pString))
+#define PrintString3(pString1,pString2,pString3) \
+  printf("%s%s%s",(pString1),(pString2),(pString3))
+
+#endif /* DEBUG_UART_H */
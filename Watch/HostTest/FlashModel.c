@@ -0,0 +1,105 @@
+//==============================================================================
+//  Copyright 2011 Meta Watch Ltd. - http://www.MetaWatch.org/
+//
+//  Licensed under the Meta Watch License, Version 1.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.MetaWatch.org/licenses/license-1.0.html
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//==============================================================================
+
+/******************************************************************************/
+/*! \file FlashModel.c
+ *
+ * Host replacement for MSP430FlashUtil.c.  Programming can only clear bits
+ * and erasing sets a whole segment to 0xff, as on the part.  Program cycles
+ * are counted the way MSP430FlashUtil.c does them: one per byte before the
+ * first long-word boundary and after the last, one per aligned long-word.
+ */
+/******************************************************************************/
+
+#include "HostTypes.h"
+#include "MSP430FlashUtil.h"
+#include "OSAL_Nv.h"
+#include "FlashModel.h"
+
+#define NV_FLASH_SIZE ( HAL_NV_PAGE_CNT * HAL_FLASH_PAGE_SIZE )
+
+__attribute__((aligned(HAL_FLASH_PAGE_SIZE)))
+unsigned char HostNvFlash[NV_FLASH_SIZE];
+
+tFlashCounters gFlashCounters;
+
+static unsigned char InFlash(unsigned char *addr, unsigned long len)
+{
+  return (   addr >= HostNvFlash
+          && addr + len <= HostNvFlash + NV_FLASH_SIZE );
+}
+
+static void FlashError(char *pString)
+{
+  printf("flash model: %s\n",pString);
+  exit(2);
+}
+
+void FlashModelReset(void)
+{
+  memset(HostNvFlash,0xff,NV_FLASH_SIZE);
+  memset(&gFlashCounters,0,sizeof(gFlashCounters));
+}
+
+unsigned long FlashModelTimeUs(void)
+{
+  return   gFlashCounters.ProgramCycles * FLASH_PROGRAM_CYCLE_US
+         + gFlashCounters.SegmentErases * FLASH_SEGMENT_ERASE_US;
+}
+
+void flashErasePage(unsigned char *addr)
+{
+  if (   InFlash(addr,1) == 0
+      || ((unsigned long)addr & (HAL_FLASH_PAGE_SIZE - 1)) != 0 )
+  {
+    FlashError("erase outside of a segment");
+  }
+
+  memset(addr,0xff,HAL_FLASH_PAGE_SIZE);
+  gFlashCounters.SegmentErases++;
+}
+
+void flashWrite(unsigned char *addr, unsigned int len, unsigned char *buf)
+{
+  unsigned long i;
+
+  if ( InFlash(addr,len) == 0 )
+  {
+    FlashError("write outside of the nv pages");
+  }
+
+  for ( i = 0; i < len; i++ )
+  {
+    /* a 0 can not be programmed back to a 1 */
+    if ( (addr[i] & buf[i]) != buf[i] )
+    {
+      FlashError("write sets a bit that is not erased");
+    }
+
+    addr[i] = buf[i];
+  }
+
+  gFlashCounters.ProgrammedBytes += len;
+
+  while ( len && ((unsigned long)addr & 3) )
+  {
+    gFlashCounters.ProgramCycles++;
+    addr++;
+    len--;
+  }
+
+  gFlashCounters.ProgramCycles += len / 4 + len % 4;
+}
@@ -0,0 +1,47 @@
+//==============================================================================
+//  Copyright 2011 Meta Watch Ltd. - http://www.MetaWatch.org/
+//
+//  Licensed under the Meta Watch License, Version 1.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.MetaWatch.org/licenses/license-1.0.html
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//==============================================================================
+
+/******************************************************************************/
+/*! \file FlashModel.h
+ *
+ * Flash model for the host test of OSAL_Nv.c
+ */
+/******************************************************************************/
+
+#ifndef FLASH_MODEL_H
+#define FLASH_MODEL_H
+
+/*! worst case MSP430F5438A timing: byte/long-word program and segment erase */
+#define FLASH_PROGRAM_CYCLE_US  ( 85UL )
+#define FLASH_SEGMENT_ERASE_US  ( 32000UL )
+
+typedef struct
+{
+  unsigned long ProgrammedBytes;
+  unsigned long ProgramCycles;
+  unsigned long SegmentErases;
+
+} tFlashCounters;
+
+extern tFlashCounters gFlashCounters;
+
+/*! Erase all of the nv pages and clear the counters */
+void FlashModelReset(void);
+
+/*! \return the flash time used so far in microseconds */
+unsigned long FlashModelTimeUs(void);
+
+#endif /* FLASH_MODEL_H */
@@ -0,0 +1,11 @@
+/* host test stand-in: the NV code runs in one thread so the mutex is a no-op */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+typedef void * xSemaphoreHandle;
+
+#define pdTRUE        ( 1 )
+#define portMAX_DELAY ( 0xffff )
+
+#endif /* INC_FREERTOS_H */
@@ -0,0 +1,50 @@
+//==============================================================================
+//  Copyright 2011 Meta Watch Ltd. - http://www.MetaWatch.org/
+//
+//  Licensed under the Meta Watch License, Version 1.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.MetaWatch.org/licenses/license-1.0.html
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//==============================================================================
+
+/******************************************************************************/
+/*! \file HostTypes.h
+ *
+ * Included first in every host test file.  The firmware sources are compiled
+ * as they are, but the NV code depends on an int being 16 bits (the item
+ * headers are four unsigned ints in 8 bytes), so int is redefined after the
+ * system headers have been read.
+ *
+ * An unsigned short is still promoted to a 32 bit int in expressions, so a
+ * subtraction that wraps on the MSP430 goes negative here.  In OSAL_Nv.c that
+ * only matters for the length checks that catch corrupt headers.
+ */
+/******************************************************************************/
+
+#ifndef HOST_TYPES_H
+#define HOST_TYPES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! The NV pages (HAL_NV_PAGE_CNT segments) live in this array instead of at
+ * 0xF200.  It is aligned to a segment so that page addresses work out.
+ */
+extern unsigned char HostNvFlash[];
+
+#define HAL_NV_PAGE_BEG ( (unsigned long)HostNvFlash / HAL_FLASH_PAGE_SIZE )
+
+/* there is no linker segment to put _nvBuf in */
+#define OAD_KEEP_NV_PAGES
+
+#define int short
+
+#endif /* HOST_TYPES_H */
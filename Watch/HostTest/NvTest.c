@@ -0,0 +1,355 @@
+//==============================================================================
+//  Copyright 2011 Meta Watch Ltd. - http://www.MetaWatch.org/
+//
+//  Licensed under the Meta Watch License, Version 1.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.MetaWatch.org/licenses/license-1.0.html
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//==============================================================================
+
+/******************************************************************************/
+/*! \file NvTest.c
+ *
+ * Host test of OSAL_Nv.c on the flash model.
+ *
+ * NvTest check  - random item writes, reads and re-inits compared with a copy
+ *                 of the items kept in RAM (returns non-zero on a mismatch)
+ * NvTest bench  - the traces behind the NV numbers in the change log
+ *
+ * Everything runs from a fixed seed so the output is the same on every run.
+ */
+/******************************************************************************/
+
+#include "HostTypes.h"
+#include "OSAL_Nv.h"
+#include "NvIds.h"
+#include "FlashModel.h"
+
+#undef int
+
+#define MAX_ITEMS        ( 50 )
+#define MAX_ITEM_LEN     ( 25 )
+#define FIRST_TEST_ID    ( 0x0100 )
+
+/* a write that takes longer than this stalls the task that asked for it */
+#define SLOW_WRITE_US    ( 10000UL )
+
+static unsigned char Model[MAX_ITEMS][MAX_ITEM_LEN];
+static unsigned char ItemLength[MAX_ITEMS];
+static unsigned char Items;
+
+static unsigned char Errors;
+
+/* the same sequence on every host, unlike rand() */
+static unsigned long Seed;
+
+static unsigned long Random(unsigned long Range)
+{
+  Seed = Seed * 1103515245UL + 12345UL;
+  return ((Seed >> 16) & 0x7fff) % Range;
+}
+
+static void Error(char *pString, unsigned int Item)
+{
+  printf("error: %s (item %u)\n",pString,Item);
+  Errors++;
+}
+
+/* what the watch does at power up: start nval and init every item */
+static void StartNv(void)
+{
+  unsigned char Buffer[MAX_ITEM_LEN];
+  unsigned char i;
+
+  OsalNvInit(0);
+
+  for ( i = 0; i < Items; i++ )
+  {
+    memcpy(Buffer,Model[i],ItemLength[i]);
+    OsalNvItemInit(FIRST_TEST_ID + i,ItemLength[i],Buffer);
+
+    if ( memcmp(Buffer,Model[i],ItemLength[i]) != 0 )
+    {
+      Error("item init returned old data",i);
+    }
+  }
+}
+
+/* start with erased flash and the given item lengths */
+static void StartTrace(unsigned char NumItems, unsigned char Length, unsigned char LongItems)
+{
+  unsigned char i;
+
+  FlashModelReset();
+
+  Items = NumItems;
+
+  for ( i = 0; i < Items; i++ )
+  {
+    ItemLength[i] = (i < LongItems) ? MAX_ITEM_LEN : Length;
+    memset(Model[i],i,ItemLength[i]);
+  }
+
+  StartNv();
+
+  /* count only the trace */
+  memset(&gFlashCounters,0,sizeof(gFlashCounters));
+}
+
+static void WriteItem(unsigned char Item, unsigned char Offset, unsigned char Length)
+{
+  unsigned char Buffer[MAX_ITEM_LEN];
+  unsigned char i;
+
+  for ( i = 0; i < Length; i++ )
+  {
+    Buffer[i] = (unsigned char)Random(256);
+  }
+
+  if ( OsalNvWrite(FIRST_TEST_ID + Item,Offset,Length,Buffer) != NV_SUCCESS )
+  {
+    Error("write failed",Item);
+  }
+
+  memcpy(&Model[Item][Offset],Buffer,Length);
+}
+
+static void CheckItem(unsigned char Item)
+{
+  unsigned char Buffer[MAX_ITEM_LEN];
+
+  if (   OsalNvRead(FIRST_TEST_ID + Item,NV_ZERO_OFFSET,ItemLength[Item],Buffer) != NV_SUCCESS
+      || memcmp(Buffer,Model[Item],ItemLength[Item]) != 0 )
+  {
+    Error("read does not match",Item);
+  }
+
+  if ( OsalNvItemLength(FIRST_TEST_ID + Item) != ItemLength[Item] )
+  {
+    Error("wrong item length",Item);
+  }
+}
+
+/* what the background task does once its queue is empty */
+static void CompactIfPending(void)
+{
+  if ( OsalNvCompactPending() )
+  {
+    OsalNvCompact();
+  }
+}
+
+/******************************************************************************/
+
+static int Check(void)
+{
+  unsigned long Op;
+  unsigned char Item;
+  unsigned char Offset;
+
+  Seed = 1;
+  StartTrace(40,4,8);
+
+  for ( Op = 0; Op < 200000 && Errors == 0; Op++ )
+  {
+    Item = (unsigned char)Random(Items);
+
+    switch ( Random(10) )
+    {
+    case 0: case 1: case 2: case 3: case 4:
+      WriteItem(Item,0,ItemLength[Item]);
+      break;
+
+    case 5:
+      Offset = (unsigned char)Random(ItemLength[Item]);
+      WriteItem(Item,Offset,(unsigned char)(1 + Random(ItemLength[Item] - Offset)));
+      break;
+
+    case 6:
+      CompactIfPending();
+      break;
+
+    default:
+      CheckItem(Item);
+      break;
+    }
+
+    if ( Random(500) == 0 )
+    {
+      StartNv();
+    }
+  }
+
+  for ( Item = 0; Item < Items; Item++ )
+  {
+    CheckItem(Item);
+  }
+
+  printf("check: %lu operations, %lu bytes in %lu program cycles, %lu erases, %s\n",
+         Op,gFlashCounters.ProgrammedBytes,gFlashCounters.ProgramCycles,
+         gFlashCounters.SegmentErases,Errors ? "FAILED" : "ok");
+
+  return Errors ? 1 : 0;
+}
+
+/******************************************************************************/
+
+/* reads of a few items (settings read on every screen) with some writes */
+static void IndexTrace(void)
+{
+  unsigned long Hits, Misses, Compares;
+  unsigned long Op;
+  unsigned char Item;
+
+  Seed = 2;
+  StartTrace(50,2,0);
+
+  for ( Op = 0; Op < 100000; Op++ )
+  {
+    /* item i is picked about twice as often as item 2i */
+    Item = (unsigned char)(Random(Random(Items) + 1));
+
+    if ( Random(20) == 0 )
+    {
+      WriteItem(Item,0,ItemLength[Item]);
+    }
+    else
+    {
+      CheckItem(Item);
+    }
+  }
+
+  OsalNvIndexStatistics(&Hits,&Misses,&Compares);
+
+  printf("index: %lu hits, %lu misses, %.1f entries compared per hit\n",
+         Hits,Misses,Hits ? (double)Compares / Hits : 0.0);
+}
+
+/* the time each write spends in flash, with and without compacting early */
+static void LatencyTrace(unsigned char Early)
+{
+  unsigned long Op;
+  unsigned long Start;
+  unsigned long Time;
+  unsigned long Worst = 0;
+  unsigned long Total = 0;
+  unsigned long Slow = 0;
+  unsigned long Compact = 0;
+  unsigned char Item;
+
+  Seed = 3;
+  StartTrace(40,4,8);
+
+  for ( Op = 0; Op < 20000; Op++ )
+  {
+    Item = (unsigned char)Random(Items);
+
+    Start = FlashModelTimeUs();
+    WriteItem(Item,0,ItemLength[Item]);
+    Time = FlashModelTimeUs() - Start;
+
+    Total += Time;
+    if ( Time > Worst ) Worst = Time;
+    if ( Time > SLOW_WRITE_US ) Slow++;
+
+    if ( Early )
+    {
+      Start = FlashModelTimeUs();
+      CompactIfPending();
+      Compact += FlashModelTimeUs() - Start;
+    }
+  }
+
+  printf("latency (%s): worst write %.1f ms, mean %.2f ms, %lu writes over %lu ms, "
+         "%lu erases, %.1f s compacting in the background\n",
+         Early ? "early compaction" : "inline compaction only",
+         Worst / 1000.0,Total / 1000.0 / Op,Slow,SLOW_WRITE_US / 1000,
+         gFlashCounters.SegmentErases,Compact / 1000000.0);
+}
+
+/* the alarm menu: 10 alarms, each stepped through 20 minutes and 7 hours and
+ * switched on, written on every change or once when the menu is left
+ */
+static void MenuTrace(unsigned char Grouped)
+{
+  unsigned char Alarm[3][10];
+  unsigned char Session, i, Step;
+  unsigned long Writes = 0;
+
+  Seed = 4;
+  StartTrace(30,1,0);
+  memset(Alarm,0,sizeof(Alarm));
+
+  for ( Session = 0; Session < 100; Session++ )
+  {
+    for ( i = 0; i < 10; i++ )
+    {
+      for ( Step = 0; Step < 28; Step++ )
+      {
+        unsigned char Group = (Step < 20) ? 1 : (Step < 27) ? 2 : 0;
+        unsigned char Item = Group * 10 + i;
+
+        Alarm[Group][i] = (Group == 0) ? !Alarm[0][i] : Alarm[Group][i] + 1;
+
+        if ( Grouped == 0 )
+        {
+          OsalNvWrite(FIRST_TEST_ID + Item,NV_ZERO_OFFSET,1,&Alarm[Group][i]);
+          Model[Item][0] = Alarm[Group][i];
+          Writes++;
+        }
+      }
+    }
+
+    if ( Grouped )
+    {
+      /* SaveAlarm() */
+      for ( i = 0; i < 30; i++ )
+      {
+        OsalNvWrite(FIRST_TEST_ID + i,NV_ZERO_OFFSET,1,&Alarm[i / 10][i % 10]);
+        Model[i][0] = Alarm[i / 10][i % 10];
+        Writes++;
+      }
+    }
+
+    CompactIfPending();
+  }
+
+  for ( i = 0; i < Items; i++ )
+  {
+    CheckItem(i);
+  }
+
+  printf("menu (%s): %lu item writes and %lu programmed bytes per session, "
+         "%lu erases in 100 sessions\n",
+         Grouped ? "grouped" : "every change",
+         Writes / 100,gFlashCounters.ProgrammedBytes / 100,
+         gFlashCounters.SegmentErases);
+}
+
+static int Bench(void)
+{
+  IndexTrace();
+  LatencyTrace(0);
+  LatencyTrace(1);
+  MenuTrace(0);
+  MenuTrace(1);
+
+  return Errors ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if ( argc > 1 && strcmp(argv[1],"bench") == 0 )
+  {
+    return Bench();
+  }
+
+  return Check();
+}
@@ -0,0 +1,21 @@
+/* host test stand-in: the NV code runs in one thread so the mutex is a no-op */
+
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+static inline xSemaphoreHandle xSemaphoreCreateMutex(void)
+{
+  return (xSemaphoreHandle)1;
+}
+
+static inline signed char xSemaphoreTake(xSemaphoreHandle xSemaphore, unsigned long xBlockTime)
+{
+  return pdTRUE;
+}
+
+static inline signed char xSemaphoreGive(xSemaphoreHandle xSemaphore)
+{
+  return pdTRUE;
+}
+
+#endif /* SEMAPHORE_H */